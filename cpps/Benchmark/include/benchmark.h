@@ -0,0 +1,83 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct BenchmarkResult {
+  std::string name;
+  // Number of inputs the kernel ran over per call.
+  int size;
+  long long operation_count;
+  double ns_per_operation;
+};
+
+// Times kernels and collects the results. A kernel is called over and over
+// until enough time has passed to average out timer resolution and noise.
+class BenchmarkRunner {
+ public:
+  explicit BenchmarkRunner(double min_seconds = 0.1)
+      : _min_seconds(min_seconds) {}
+
+  // run_kernel() has to perform size operations per call, and write its
+  // results somewhere that outlives it so that the compiler cannot drop them.
+  template <class Kernel>
+  void Run(const std::string &name, int size, Kernel run_kernel);
+
+  const std::vector<BenchmarkResult> &GetResults() const { return _results; }
+
+  // {"benchmarks": [{"name": ..., "size": ..., "operations": ...,
+  // "ns_per_op": ...}, ...]}
+  void WriteJson(std::ostream &stream) const;
+
+ private:
+  double _min_seconds;
+  std::vector<BenchmarkResult> _results;
+};
+
+template <class Kernel>
+void BenchmarkRunner::Run(const std::string &name, int size,
+                          Kernel run_kernel) {
+  // Once untimed, to fault in the inputs and warm up the caches.
+  run_kernel();
+
+  long long call_count = 0;
+  double elapsed_seconds = 0;
+  const auto start = std::chrono::steady_clock::now();
+  while (elapsed_seconds < _min_seconds) {
+    run_kernel();
+    ++call_count;
+    elapsed_seconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+  }
+
+  const long long operation_count = call_count * size;
+  _results.push_back(
+      {name, size, operation_count, elapsed_seconds * 1e9 / operation_count});
+}
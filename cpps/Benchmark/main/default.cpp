@@ -0,0 +1,217 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "geometry/mat.h"
+#include "geometry/utils.h"
+#include "geometry/vec.h"
+#include "image.h"
+#include "our_gl.h"
+#include "shape.h"
+
+namespace {
+
+// Inputs are drawn with a fixed seed, so that every run times the same work.
+std::mt19937 random_engine(1);
+
+float GetRandomFloat(float min, float max) {
+  return std::uniform_real_distribution<float>(min, max)(random_engine);
+}
+
+template <size_t n>
+std::vector<Vec<n, float>> GetRandomVecs(int count, float min, float max) {
+  std::vector<Vec<n, float>> vecs(count);
+  for (Vec<n, float> &vec : vecs) {
+    for (int i = 0; i != n; ++i) {
+      vec[i] = GetRandomFloat(min, max);
+    }
+  }
+  return vecs;
+}
+
+std::vector<Vec<3, float>> GetRandomDirections(int count) {
+  std::vector<Vec<3, float>> directions = GetRandomVecs<3>(count, -1, 1);
+  for (Vec<3, float> &direction : directions) {
+    direction.Normalize();
+  }
+  return directions;
+}
+
+template <size_t n>
+std::vector<Mat<n, n, float>> GetRandomMats(int count) {
+  std::vector<Mat<n, n, float>> mats(count);
+  for (Mat<n, n, float> &mat : mats) {
+    for (int i = 0; i != n; ++i) {
+      for (int j = 0; j != n; ++j) {
+        mat[i][j] = GetRandomFloat(-1, 1);
+      }
+    }
+  }
+  return mats;
+}
+
+void RunBenchmarks(BenchmarkRunner &runner, int size) {
+  const std::vector<Vec<3, float>> a = GetRandomVecs<3>(size, -1, 1);
+  const std::vector<Vec<3, float>> b = GetRandomVecs<3>(size, -1, 1);
+  std::vector<float> float_results(size);
+  std::vector<Vec<3, float>> vec_results(size);
+
+  runner.Run("vec3_dot", size, [&] {
+    for (int k = 0; k != size; ++k) {
+      float_results[k] = a[k] * b[k];
+    }
+  });
+
+  runner.Run("vec3_cross", size, [&] {
+    for (int k = 0; k != size; ++k) {
+      vec_results[k] = a[k] ^ b[k];
+    }
+  });
+
+  runner.Run("vec3_normalize", size, [&] {
+    for (int k = 0; k != size; ++k) {
+      vec_results[k] = a[k];
+      vec_results[k].Normalize();
+    }
+  });
+
+  {
+    const std::vector<Mat<4, 4, float>> m = GetRandomMats<4>(size);
+    const std::vector<Mat<4, 4, float>> n = GetRandomMats<4>(size);
+    std::vector<Mat<4, 4, float>> mat_results(size);
+
+    runner.Run("mat4_multiply", size, [&] {
+      for (int k = 0; k != size; ++k) {
+        mat_results[k] = m[k] * n[k];
+      }
+    });
+  }
+
+  {
+    const std::vector<Mat<3, 3, float>> m = GetRandomMats<3>(size);
+    std::vector<Mat<3, 3, float>> mat_results(size);
+
+    runner.Run("mat3_inverse", size, [&] {
+      for (int k = 0; k != size; ++k) {
+        mat_results[k] = Inverse(m[k]);
+      }
+    });
+  }
+
+  {
+    // Rays start around the shapes and point anywhere, so that about half
+    // of them hit.
+    const std::vector<Vec<3, float>> origins = GetRandomVecs<3>(size, -4, 4);
+    const std::vector<Vec<3, float>> directions = GetRandomDirections(size);
+    const float max_distance = std::numeric_limits<float>::max();
+
+    std::vector<Sphere> spheres;
+    std::vector<Plane> planes;
+    for (int k = 0; k != size; ++k) {
+      spheres.push_back(Sphere(SolidMaterial(), GetRandomFloat(0.5f, 2),
+                               GetRandomVecs<3>(1, -1, 1)[0]));
+      // The plane checks for an exactly unit normal, so take a signed axis.
+      Vec<3, float> normal;
+      normal[random_engine() % 3] = random_engine() % 2 == 0 ? 1.f : -1.f;
+      planes.push_back(Plane(SolidMaterial(), normal,
+                             GetRandomVecs<3>(1, -1, 1)[0],
+                             GetRandomFloat(1, 4), GetRandomFloat(1, 4)));
+    }
+
+    runner.Run("sphere_intersection", size, [&] {
+      for (int k = 0; k != size; ++k) {
+        float_results[k] = spheres[k].GetIntersectionDistance(
+            origins[k], directions[k], max_distance);
+      }
+    });
+
+    runner.Run("plane_intersection", size, [&] {
+      for (int k = 0; k != size; ++k) {
+        float_results[k] = planes[k].GetIntersectionDistance(
+            origins[k], directions[k], max_distance);
+      }
+    });
+  }
+
+  {
+    const std::vector<Vec<2, float>> targets = GetRandomVecs<2>(size, 0, 100);
+    const std::vector<Vec<2, float>> p0 = GetRandomVecs<2>(size, 0, 100);
+    const std::vector<Vec<2, float>> p1 = GetRandomVecs<2>(size, 0, 100);
+    const std::vector<Vec<2, float>> p2 = GetRandomVecs<2>(size, 0, 100);
+
+    runner.Run("barycentric", size, [&] {
+      for (int k = 0; k != size; ++k) {
+        vec_results[k] = GetBarycentric(targets[k], p0[k], p1[k], p2[k]);
+      }
+    });
+  }
+
+  {
+    const std::vector<Vec<3, float>> normals = GetRandomDirections(size);
+    const std::vector<Vec<3, float>> view_vectors = GetRandomDirections(size);
+    const std::vector<Vec<3, float>> light_dirs = GetRandomDirections(size);
+    std::vector<RgbaColor> colors(size);
+    for (RgbaColor &color : colors) {
+      color = RgbaColor(random_engine() % 256, random_engine() % 256,
+                        random_engine() % 256);
+    }
+    std::vector<RgbaColor> color_results(size);
+
+    runner.Run("phong_color", size, [&] {
+      for (int k = 0; k != size; ++k) {
+        color_results[k] = GetPhongColor(normals[k], view_vectors[k],
+                                         light_dirs[k], colors[k]);
+      }
+    });
+  }
+}
+
+}  // namespace
+
+// Usage: Benchmark [result.json]
+// Times the geometry and shading kernels over inputs of a few sizes, from
+// ones that fit in the L1 cache to ones that do not fit in L2, and writes the
+// nanoseconds per operation as JSON to the given file or to stdout.
+int main(int argc, char **argv) {
+  BenchmarkRunner runner;
+  for (int size : {16, 1024, 65536}) {
+    RunBenchmarks(runner, size);
+  }
+
+  if (argc > 1) {
+    std::ofstream file(argv[1]);
+    runner.WriteJson(file);
+  } else {
+    runner.WriteJson(std::cout);
+  }
+
+  return 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "geometry/vec.h"
+
+// Axis-aligned bounding box. A default constructed box is empty and grows
+// with Extend().
+struct Aabb {
+  Vec<3, float> min;
+  Vec<3, float> max;
+
+  Aabb()
+      : min(Vec<3, float>({std::numeric_limits<float>::infinity(),
+                           std::numeric_limits<float>::infinity(),
+                           std::numeric_limits<float>::infinity()})),
+        max(Vec<3, float>({-std::numeric_limits<float>::infinity(),
+                           -std::numeric_limits<float>::infinity(),
+                           -std::numeric_limits<float>::infinity()})) {}
+  Aabb(const Vec<3, float> &min, const Vec<3, float> &max)
+      : min(min), max(max) {}
+
+  void Extend(const Vec<3, float> &point) {
+    for (int i = 0; i != 3; ++i) {
+      min[i] = std::min(min[i], point[i]);
+      max[i] = std::max(max[i], point[i]);
+    }
+  }
+  void Extend(const Aabb &other) {
+    for (int i = 0; i != 3; ++i) {
+      min[i] = std::min(min[i], other.min[i]);
+      max[i] = std::max(max[i], other.max[i]);
+    }
+  }
+
+  bool IsFinite() const {
+    for (int i = 0; i != 3; ++i) {
+      if (!std::isfinite(min[i]) || !std::isfinite(max[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  Vec<3, float> GetCenter() const { return (min + max) * 0.5f; }
+
+  float GetSurfaceArea() const {
+    Vec<3, float> extent = max - min;
+    return 2 * (extent[0] * extent[1] + extent[1] * extent[2] +
+                extent[2] * extent[0]);
+  }
+
+  // Slab test. inverse_direction holds 1 / direction per axis, so rays
+  // parallel to an axis get infinities and still work.
+  bool Intersect(const Vec<3, float> &origin,
+                 const Vec<3, float> &inverse_direction, float max_distance,
+                 float &entry_distance) const {
+    float entry = 0;
+    float exit = max_distance;
+
+    for (int i = 0; i != 3; ++i) {
+      float near = (min[i] - origin[i]) * inverse_direction[i];
+      float far = (max[i] - origin[i]) * inverse_direction[i];
+      if (near > far) {
+        std::swap(near, far);
+      }
+
+      // Written so that a NaN from 0 * inf leaves the interval unchanged.
+      entry = near > entry ? near : entry;
+      exit = far < exit ? far : exit;
+    }
+
+    entry_distance = entry;
+    return entry <= exit;
+  }
+};
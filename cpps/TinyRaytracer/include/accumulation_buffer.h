@@ -0,0 +1,115 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "./image.h"
+#include "./radiance.h"
+
+// Running sums of the radiance samples taken for every pixel, so that later
+// passes can add samples to what earlier passes found. The channels are kept
+// in separate planes for the SIMD tone mapping in Resolve(). Besides the
+// radiance, the buffer tracks what adaptive sampling needs to decide whether
+// a pixel wants more samples: the luminance variance and whether the samples
+// hit different shapes.
+class AccumulationBuffer {
+ public:
+  AccumulationBuffer(int width, int height)
+      : _width(width),
+        _height(height),
+        _red_sums(width * height),
+        _green_sums(width * height),
+        _blue_sums(width * height),
+        _sample_counts(width * height),
+        _luminance_sums(width * height),
+        _luminance_square_sums(width * height),
+        _shape_ids(width * height),
+        _has_mixed_shapes(width * height) {}
+
+  int GetWidth() const { return _width; }
+  int GetHeight() const { return _height; }
+
+  // Pixels are only ever touched by one thread at a time, so different
+  // threads may add samples to different pixels concurrently. shape_id is the
+  // shape the primary ray hit, -1 for the background.
+  void Add(int x, int y, const Radiance &radiance, int shape_id) {
+    const int index = y * _width + x;
+
+    _red_sums[index] += radiance.r;
+    _green_sums[index] += radiance.g;
+    _blue_sums[index] += radiance.b;
+
+    // Variance is measured on what the image can show.
+    const float luminance = std::min(radiance.GetLuminance(), 1.f);
+    _luminance_sums[index] += luminance;
+    _luminance_square_sums[index] += luminance * luminance;
+
+    if (_sample_counts[index] == 0) {
+      _shape_ids[index] = shape_id;
+    } else if (_shape_ids[index] != shape_id) {
+      _has_mixed_shapes[index] = 1;
+    }
+    ++_sample_counts[index];
+  }
+
+  int GetSampleCount(int x, int y) const {
+    return _sample_counts[y * _width + x];
+  }
+
+  // Variance of the sample luminances, with luminance in [0, 1].
+  float GetLuminanceVariance(int x, int y) const {
+    const int index = y * _width + x;
+    const float count = static_cast<float>(_sample_counts[index]);
+    const float mean = _luminance_sums[index] / count;
+
+    return std::max(0.f, _luminance_square_sums[index] / count - mean * mean);
+  }
+
+  // Whether the primary rays of the pixel hit more than one shape, or a shape
+  // and the background.
+  bool HasMixedShapes(int x, int y) const {
+    return _has_mixed_shapes[y * _width + x] != 0;
+  }
+
+  // Tone maps the mean radiance of every pixel that has samples into image,
+  // which must have the size of the buffer. Pixels without samples are left
+  // as they are.
+  void Resolve(Image<RgbaColor> &image) const;
+
+ private:
+  int _width;
+  int _height;
+  std::vector<float> _red_sums;
+  std::vector<float> _green_sums;
+  std::vector<float> _blue_sums;
+  std::vector<int> _sample_counts;
+  std::vector<float> _luminance_sums;
+  std::vector<float> _luminance_square_sums;
+  std::vector<int> _shape_ids;
+  // Not std::vector<bool>: its bits share words across pixels.
+  std::vector<uint8_t> _has_mixed_shapes;
+};
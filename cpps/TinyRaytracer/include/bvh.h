@@ -0,0 +1,204 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "./aabb.h"
+#include "./ray_packet.h"
+#include "geometry/vec.h"
+
+struct BvhNode {
+  Aabb bounds;
+  // Leaves: position of the first primitive in GetPrimitiveIndices().
+  // Inner nodes: index of the right child. The left child always follows its
+  // parent directly.
+  int first;
+  // Number of primitives for leaves, 0 for inner nodes.
+  int count;
+};
+
+// Bounding volume hierarchy over a list of primitive bounds, built with a
+// binned surface area heuristic. Primitives with infinite bounds cannot be
+// placed in the tree and are visited on every traversal instead.
+//
+// GetPrimitiveIndices() lists the primitives so that every leaf covers a
+// contiguous run of it, followed by the unbounded primitives. Callers that
+// store their primitives in that order can loop over a leaf directly.
+class Bvh {
+ public:
+  static const int kDefaultMaxLeafSize = 4;
+
+  Bvh() = default;
+  // Leaves hold at most max_leaf_size primitives.
+  explicit Bvh(const std::vector<Aabb> &primitive_bounds,
+               int max_leaf_size = kDefaultMaxLeafSize);
+
+  const std::vector<BvhNode> &GetNodes() const { return _nodes; }
+  const std::vector<int> &GetPrimitiveIndices() const {
+    return _primitive_indices;
+  }
+
+  // Calls leaf_function(first, count) for every leaf the ray enters before
+  // max_distance, nearest leaves first. first and count select a run of
+  // GetPrimitiveIndices(). max_distance is read again before every node, so a
+  // closest-hit query can shrink it from inside leaf_function. Returning true
+  // from leaf_function ends the traversal.
+  template <class LeafFunction>
+  void Traverse(const Vec<3, float> &origin, const Vec<3, float> &direction,
+                const float &max_distance, LeafFunction leaf_function) const;
+
+  // Packet version of Traverse(). A node is visited when any active lane
+  // enters it before that lane's max_distance; leaf_function then has to
+  // test every lane.
+  template <class LeafFunction>
+  void TraversePacket(const RayPacket &packet,
+                      const PacketFloat &max_distance,
+                      LeafFunction leaf_function) const;
+
+ private:
+  static const int kMaxStackSize = 64;
+
+  void Build(int node_index, int first, int count, int depth,
+             const std::vector<Aabb> &primitive_bounds,
+             const std::vector<Vec<3, float>> &centers);
+
+  int _max_leaf_size = kDefaultMaxLeafSize;
+  std::vector<BvhNode> _nodes;
+  std::vector<int> _primitive_indices;
+  int _bounded_count = 0;
+};
+
+template <class LeafFunction>
+void Bvh::Traverse(const Vec<3, float> &origin,
+                   const Vec<3, float> &direction, const float &max_distance,
+                   LeafFunction leaf_function) const {
+  const int unbounded_count = _primitive_indices.size() - _bounded_count;
+  if (unbounded_count > 0 && leaf_function(_bounded_count, unbounded_count)) {
+    return;
+  }
+
+  if (_nodes.empty()) {
+    return;
+  }
+
+  Vec<3, float> inverse_direction(
+      {1.f / direction[0], 1.f / direction[1], 1.f / direction[2]});
+
+  float entry_distance;
+  if (!_nodes[0].bounds.Intersect(origin, inverse_direction, max_distance,
+                                  entry_distance)) {
+    return;
+  }
+
+  int stack[kMaxStackSize];
+  float stack_entry_distances[kMaxStackSize];
+  int stack_size = 0;
+  int node_index = 0;
+
+  while (true) {
+    const BvhNode &node = _nodes[node_index];
+
+    if (node.count > 0) {
+      if (leaf_function(node.first, node.count)) {
+        return;
+      }
+    } else {
+      int left_index = node_index + 1;
+      int right_index = node.first;
+
+      float left_entry;
+      float right_entry;
+      bool is_left_hit = _nodes[left_index].bounds.Intersect(
+          origin, inverse_direction, max_distance, left_entry);
+      bool is_right_hit = _nodes[right_index].bounds.Intersect(
+          origin, inverse_direction, max_distance, right_entry);
+
+      if (is_left_hit && is_right_hit) {
+        if (right_entry < left_entry) {
+          std::swap(left_index, right_index);
+          std::swap(left_entry, right_entry);
+        }
+
+        stack[stack_size] = right_index;
+        stack_entry_distances[stack_size] = right_entry;
+        ++stack_size;
+        node_index = left_index;
+        continue;
+      }
+
+      if (is_left_hit || is_right_hit) {
+        node_index = is_left_hit ? left_index : right_index;
+        continue;
+      }
+    }
+
+    // Pop the next node, skipping those that a closer hit has ruled out.
+    do {
+      if (stack_size == 0) {
+        return;
+      }
+      --stack_size;
+    } while (stack_entry_distances[stack_size] > max_distance);
+
+    node_index = stack[stack_size];
+  }
+}
+
+template <class LeafFunction>
+void Bvh::TraversePacket(const RayPacket &packet,
+                         const PacketFloat &max_distance,
+                         LeafFunction leaf_function) const {
+  const int unbounded_count = _primitive_indices.size() - _bounded_count;
+  if (unbounded_count > 0 && leaf_function(_bounded_count, unbounded_count)) {
+    return;
+  }
+
+  if (_nodes.empty()) {
+    return;
+  }
+
+  int stack[kMaxStackSize];
+  int stack_size = 0;
+  stack[stack_size++] = 0;
+
+  while (stack_size > 0) {
+    const int node_index = stack[--stack_size];
+    const BvhNode &node = _nodes[node_index];
+
+    if (!IntersectPacket(node.bounds, packet, max_distance).Any()) {
+      continue;
+    }
+
+    if (node.count > 0) {
+      if (leaf_function(node.first, node.count)) {
+        return;
+      }
+    } else {
+      stack[stack_size++] = node.first;
+      stack[stack_size++] = node_index + 1;
+    }
+  }
+}
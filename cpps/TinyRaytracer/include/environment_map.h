@@ -0,0 +1,58 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "./geometry/vec.h"
+#include "./image.h"
+#include "./radiance.h"
+
+// The background of a render as a cube map. It is converted once from a
+// latitude-longitude image, so that a lookup only has to pick the face of the
+// major axis of the direction and blend four texels, without any
+// trigonometry. Build it when the image is loaded and keep it around for as
+// many renders as use that image.
+class EnvironmentMap {
+ public:
+  // The faces get half the height of the image as their size, which keeps
+  // the resolution of the image along the horizon.
+  explicit EnvironmentMap(const Image<RgbaColor> &lat_long_image);
+
+  // Bilinearly filtered radiance seen in direction, which need not be
+  // normalized.
+  Radiance Lookup(const Vec<3, float> &direction) const;
+
+  int GetFaceSize() const { return _face_size; }
+
+ private:
+  // Faces are stored +x, -x, +y, -y, +z, -z, each row by row.
+  const RgbaColor &GetTexel(int face, int x, int y) const {
+    return _texels[(face * _face_size + y) * _face_size + x];
+  }
+
+  int _face_size;
+  std::vector<RgbaColor> _texels;
+};
@@ -0,0 +1,321 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <utility>
+
+#include "./ray_packet.h"
+#include "./simd.h"
+#include "geometry/utils.h"
+#include "geometry/vec.h"
+
+// Ray-primitive kernels on plain floats, shared by the Shape classes and the
+// compiled Scene. Every kernel returns the distance to the intersection or -1.
+// The scalar and packet versions do the same operations in the same order, so
+// each lane rounds exactly like a single ray would.
+
+inline float IntersectSphere(const Vec<3, float> &origin,
+                             const Vec<3, float> &direction, float ray_length,
+                             float center_x, float center_y, float center_z,
+                             float radius, float radius_squared) {
+  const float origin_x = origin[0];
+  const float origin_y = origin[1];
+  const float origin_z = origin[2];
+  const float direction_x = direction[0];
+  const float direction_y = direction[1];
+  const float direction_z = direction[2];
+
+  // 1. If the ray is already inside the sphere, return the value.
+  float center_to_origin_x = origin_x - center_x;
+  float center_to_origin_y = origin_y - center_y;
+  float center_to_origin_z = origin_z - center_z;
+  float distance_between_origins =
+      std::sqrt(center_to_origin_x * center_to_origin_x +
+                center_to_origin_y * center_to_origin_y +
+                center_to_origin_z * center_to_origin_z);
+  if (distance_between_origins < radius) {
+    return distance_between_origins;
+  }
+
+  // 2. If the ray direction is not pointing to the sphere, return -1.
+  float distance_to_nearest = (center_x - origin_x) * direction_x +
+                              (center_y - origin_y) * direction_y +
+                              (center_z - origin_z) * direction_z;
+  if (distance_to_nearest <= 0) {
+    return -1;
+  }
+
+  // 3. Get the nearest point from the ray to the sphere.
+  float nearest_to_center_x =
+      (origin_x + direction_x * distance_to_nearest) - center_x;
+  float nearest_to_center_y =
+      (origin_y + direction_y * distance_to_nearest) - center_y;
+  float nearest_to_center_z =
+      (origin_z + direction_z * distance_to_nearest) - center_z;
+
+  // 4. If the distance between the nearest point and the sphere is more than
+  // the radius, return -1.
+  float distance_nearest_center =
+      std::sqrt(nearest_to_center_x * nearest_to_center_x +
+                nearest_to_center_y * nearest_to_center_y +
+                nearest_to_center_z * nearest_to_center_z);
+  if (distance_nearest_center > radius) {
+    return -1;
+  }
+
+  // 5. Get the distance between the ray origin and the intersecting point.
+  float distance_nearest_intersection = std::sqrt(
+      radius_squared - distance_nearest_center * distance_nearest_center);
+  float distance_origin_intersection =
+      distance_to_nearest - distance_nearest_intersection;
+
+  // 6. If the distance to intersection is over the ray length, return -1, else
+  // return the distance.
+  return distance_origin_intersection > ray_length
+             ? -1
+             : distance_origin_intersection;
+}
+
+// The plane is limited to |x - center_x| <= half_width and
+// |z - center_z| <= half_height.
+inline float IntersectPlane(const Vec<3, float> &origin,
+                            const Vec<3, float> &direction, float ray_length,
+                            float center_x, float center_y, float center_z,
+                            float normal_x, float normal_y, float normal_z,
+                            float half_width, float half_height) {
+  const float origin_x = origin[0];
+  const float origin_y = origin[1];
+  const float origin_z = origin[2];
+  const float direction_x = direction[0];
+  const float direction_y = direction[1];
+  const float direction_z = direction[2];
+
+  // 1. If the ray is parallel to the plane, return -1.
+  float denominator = normal_x * direction_x + normal_y * direction_y +
+                      normal_z * direction_z;
+  if (std::fabs(denominator) < kEpsilon) {
+    return -1;
+  }
+
+  // 2. Get the distance between the origin and the plane.
+  float distance = ((center_x - origin_x) * normal_x +
+                    (center_y - origin_y) * normal_y +
+                    (center_z - origin_z) * normal_z) /
+                   denominator;
+
+  // 3. If the distance is negative or over the ray length, return -1.
+  if (distance < 0 || distance > ray_length) {
+    return -1;
+  }
+
+  // 4. Get the intersection point.
+  float intersection_x = origin_x + direction_x * distance;
+  float intersection_z = origin_z + direction_z * distance;
+
+  // 5. If the intersection point is inside the plane, return the distance.
+  if (std::fabs(intersection_x - center_x) <= half_width &&
+      std::fabs(intersection_z - center_z) <= half_height) {
+    return distance;
+  }
+
+  // 6. Return -1.
+  return -1;
+}
+
+inline PacketFloat IntersectSpherePacket(const RayPacket &packet,
+                                         const PacketFloat &ray_length,
+                                         float center_x, float center_y,
+                                         float center_z, float radius,
+                                         float radius_squared) {
+  const PacketFloat center[3] = {PacketFloat(center_x), PacketFloat(center_y),
+                                 PacketFloat(center_z)};
+  const PacketFloat lane_radius(radius);
+
+  // 1. Rays starting inside the sphere.
+  PacketFloat center_to_origin[3];
+  for (int i = 0; i != 3; ++i) {
+    center_to_origin[i] = packet.origin[i] - center[i];
+  }
+  PacketFloat distance_between_origins =
+      Sqrt(center_to_origin[0] * center_to_origin[0] +
+           center_to_origin[1] * center_to_origin[1] +
+           center_to_origin[2] * center_to_origin[2]);
+  PacketMask is_inside = distance_between_origins < lane_radius;
+
+  // 2. Rays pointing away from the sphere.
+  PacketFloat distance_to_nearest =
+      (center[0] - packet.origin[0]) * packet.direction[0] +
+      (center[1] - packet.origin[1]) * packet.direction[1] +
+      (center[2] - packet.origin[2]) * packet.direction[2];
+  PacketMask is_missed = distance_to_nearest <= PacketFloat(0.f);
+
+  // 3, 4. Rays passing the sphere.
+  PacketFloat nearest_to_center[3];
+  for (int i = 0; i != 3; ++i) {
+    nearest_to_center[i] =
+        (packet.origin[i] + packet.direction[i] * distance_to_nearest) -
+        center[i];
+  }
+  PacketFloat distance_nearest_center =
+      Sqrt(nearest_to_center[0] * nearest_to_center[0] +
+           nearest_to_center[1] * nearest_to_center[1] +
+           nearest_to_center[2] * nearest_to_center[2]);
+  is_missed = is_missed | (distance_nearest_center > lane_radius);
+
+  // 5, 6. Distance to the intersection, limited by the ray length.
+  PacketFloat distance_nearest_intersection =
+      Sqrt(PacketFloat(radius_squared) -
+           distance_nearest_center * distance_nearest_center);
+  PacketFloat distance_origin_intersection =
+      distance_to_nearest - distance_nearest_intersection;
+  is_missed = is_missed | (distance_origin_intersection > ray_length);
+
+  return Select(is_inside, distance_between_origins,
+                Select(is_missed, PacketFloat(-1.f),
+                       distance_origin_intersection));
+}
+
+inline PacketFloat IntersectPlanePacket(
+    const RayPacket &packet, const PacketFloat &ray_length, float center_x,
+    float center_y, float center_z, float normal_x, float normal_y,
+    float normal_z, float half_width, float half_height) {
+  const PacketFloat center[3] = {PacketFloat(center_x), PacketFloat(center_y),
+                                 PacketFloat(center_z)};
+  const PacketFloat normal[3] = {PacketFloat(normal_x), PacketFloat(normal_y),
+                                 PacketFloat(normal_z)};
+
+  // 1. Rays parallel to the plane.
+  PacketFloat denominator = normal[0] * packet.direction[0] +
+                            normal[1] * packet.direction[1] +
+                            normal[2] * packet.direction[2];
+  PacketMask is_missed = Abs(denominator) < PacketFloat(kEpsilon);
+
+  // 2, 3. Distance to the plane, which must lie within the ray.
+  PacketFloat distance = ((center[0] - packet.origin[0]) * normal[0] +
+                          (center[1] - packet.origin[1]) * normal[1] +
+                          (center[2] - packet.origin[2]) * normal[2]) /
+                         denominator;
+  is_missed =
+      is_missed | (distance < PacketFloat(0.f)) | (distance > ray_length);
+
+  // 4, 5. The intersection point must be inside the plane.
+  PacketFloat intersection_x = packet.origin[0] + packet.direction[0] * distance;
+  PacketFloat intersection_z = packet.origin[2] + packet.direction[2] * distance;
+  PacketMask is_inside =
+      (Abs(intersection_x - center[0]) <= PacketFloat(half_width)) &
+      (Abs(intersection_z - center[2]) <= PacketFloat(half_height));
+
+  return Select(is_inside.AndNot(is_missed), distance, PacketFloat(-1.f));
+}
+
+// Per-ray setup of the watertight ray-triangle test by Woop, Benthin and
+// Wald. The ray is sheared so that it runs along +z, which turns the test
+// into 2D edge functions. Two triangles sharing an edge evaluate that edge
+// identically, so a ray cannot slip through the gap between them.
+struct WatertightRay {
+  Vec<3, float> origin;
+  // The axis with the largest direction component becomes z.
+  int kx;
+  int ky;
+  int kz;
+  float shear_x;
+  float shear_y;
+  float shear_z;
+};
+
+inline WatertightRay GetWatertightRay(const Vec<3, float> &origin,
+                                      const Vec<3, float> &direction) {
+  WatertightRay ray;
+  ray.origin = origin;
+
+  ray.kz = 0;
+  if (std::fabs(direction[1]) > std::fabs(direction[ray.kz])) ray.kz = 1;
+  if (std::fabs(direction[2]) > std::fabs(direction[ray.kz])) ray.kz = 2;
+  ray.kx = (ray.kz + 1) % 3;
+  ray.ky = (ray.kx + 1) % 3;
+  // Keeps the winding of the triangles.
+  if (direction[ray.kz] < 0) {
+    std::swap(ray.kx, ray.ky);
+  }
+
+  ray.shear_x = direction[ray.kx] / direction[ray.kz];
+  ray.shear_y = direction[ray.ky] / direction[ray.kz];
+  ray.shear_z = 1 / direction[ray.kz];
+  return ray;
+}
+
+// Tests one ray against kPacketSize triangles, one per lane, read from
+// structure of arrays: vertices[v][axis] points at the given coordinate of
+// vertex v of the first triangle. Both windings are hit. Returns the
+// distance per lane, or -1, and in u and v the barycentric weights of the
+// second and the third vertex.
+inline PacketFloat IntersectTrianglesPacket(
+    const WatertightRay &ray, const float *const (&vertices)[3][3],
+    const PacketFloat &ray_length, PacketFloat &u, PacketFloat &v) {
+  const PacketFloat origin_x(ray.origin[ray.kx]);
+  const PacketFloat origin_y(ray.origin[ray.ky]);
+  const PacketFloat origin_z(ray.origin[ray.kz]);
+  const PacketFloat shear_x(ray.shear_x);
+  const PacketFloat shear_y(ray.shear_y);
+  const PacketFloat shear_z(ray.shear_z);
+
+  // Vertices relative to the origin, sheared and projected onto the plane
+  // perpendicular to the ray.
+  PacketFloat x[3];
+  PacketFloat y[3];
+  PacketFloat z[3];
+  for (int i = 0; i != 3; ++i) {
+    PacketFloat relative_z = PacketFloat::Load(vertices[i][ray.kz]) - origin_z;
+    x[i] = PacketFloat::Load(vertices[i][ray.kx]) - origin_x -
+           shear_x * relative_z;
+    y[i] = PacketFloat::Load(vertices[i][ray.ky]) - origin_y -
+           shear_y * relative_z;
+    z[i] = shear_z * relative_z;
+  }
+
+  // Scaled barycentric coordinates: edge functions of the edges opposite to
+  // each vertex, evaluated at the ray.
+  PacketFloat edge0 = x[2] * y[1] - y[2] * x[1];
+  PacketFloat edge1 = x[0] * y[2] - y[0] * x[2];
+  PacketFloat edge2 = x[1] * y[0] - y[1] * x[0];
+
+  const PacketFloat zero(0.f);
+  PacketMask has_negative = (edge0 < zero) | (edge1 < zero) | (edge2 < zero);
+  PacketMask has_positive = (edge0 > zero) | (edge1 > zero) | (edge2 > zero);
+
+  PacketFloat determinant = edge0 + edge1 + edge2;
+  PacketFloat distance =
+      (edge0 * z[0] + edge1 * z[1] + edge2 * z[2]) / determinant;
+
+  // A zero determinant gives NaN, which fails every comparison.
+  PacketMask is_hit = ((distance > zero) & (distance <= ray_length))
+                          .AndNot(has_negative & has_positive);
+
+  PacketFloat inverse_determinant = PacketFloat(1.f) / determinant;
+  u = edge1 * inverse_determinant;
+  v = edge2 * inverse_determinant;
+  return Select(is_hit, distance, PacketFloat(-1.f));
+}
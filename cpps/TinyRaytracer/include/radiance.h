@@ -0,0 +1,70 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "./image.h"
+
+// Linear RGB radiance used for shading. Unlike RgbaColor it neither clamps
+// nor rounds, so reflections and highlights add up without losing precision
+// along the way; values are only quantized once, when the image is written.
+// 1 is the brightest value an 8-bit channel can show.
+struct Radiance {
+  float r;
+  float g;
+  float b;
+
+  Radiance() : r(0), g(0), b(0) {}
+  Radiance(float r, float g, float b) : r(r), g(g), b(b) {}
+  explicit Radiance(const RgbaColor &color)
+      : r(color.r / 255.f), g(color.g / 255.f), b(color.b / 255.f) {}
+
+  Radiance &operator+=(const Radiance &other) {
+    r += other.r;
+    g += other.g;
+    b += other.b;
+    return *this;
+  }
+
+  Radiance operator+(const Radiance &other) const {
+    Radiance result = *this;
+    result += other;
+    return result;
+  }
+
+  Radiance &operator*=(float scalar) {
+    r *= scalar;
+    g *= scalar;
+    b *= scalar;
+    return *this;
+  }
+
+  Radiance operator*(float scalar) const {
+    Radiance result = *this;
+    result *= scalar;
+    return result;
+  }
+
+  float GetLuminance() const { return 0.2126f * r + 0.7152f * g + 0.0722f * b; }
+};
@@ -0,0 +1,80 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+
+// Work counted over a render, per thread while it runs and merged at the
+// end. Counting is compiled in with TINY_RAYTRACER_STATS only; otherwise the
+// counters stay at zero and cost nothing.
+struct RayCounters {
+  long long reflection_ray_count = 0;
+  // Ray-primitive tests by shape type. A packet test counts once per active
+  // lane.
+  long long sphere_test_count = 0;
+  long long plane_test_count = 0;
+  long long triangle_test_count = 0;
+  // Rays moved into the space of an instance.
+  long long instance_test_count = 0;
+  long long background_lookup_count = 0;
+  // Most reflections along one path.
+  int max_depth = 0;
+
+  void Merge(const RayCounters &other) {
+    reflection_ray_count += other.reflection_ray_count;
+    sphere_test_count += other.sphere_test_count;
+    plane_test_count += other.plane_test_count;
+    triangle_test_count += other.triangle_test_count;
+    instance_test_count += other.instance_test_count;
+    background_lookup_count += other.background_lookup_count;
+    max_depth = std::max(max_depth, other.max_depth);
+  }
+};
+
+#ifdef TINY_RAYTRACER_STATS
+inline constexpr bool kCountRays = true;
+#else
+inline constexpr bool kCountRays = false;
+#endif
+
+// The counters of the calling thread, or null while no render is counting.
+inline thread_local RayCounters *thread_ray_counters = nullptr;
+
+inline void CountRays(long long RayCounters::*counter, long long amount = 1) {
+  if constexpr (kCountRays) {
+    if (thread_ray_counters != nullptr) {
+      thread_ray_counters->*counter += amount;
+    }
+  }
+}
+
+inline void CountDepth(int depth) {
+  if constexpr (kCountRays) {
+    if (thread_ray_counters != nullptr) {
+      thread_ray_counters->max_depth =
+          std::max(thread_ray_counters->max_depth, depth);
+    }
+  }
+}
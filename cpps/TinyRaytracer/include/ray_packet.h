@@ -0,0 +1,62 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "./aabb.h"
+#include "./simd.h"
+
+// Up to kPacketSize rays in structure-of-arrays form. Lanes outside the
+// active mask hold valid but meaningless rays and must be ignored.
+struct RayPacket {
+  PacketFloat origin[3];
+  PacketFloat direction[3];
+  PacketFloat inverse_direction[3];
+  PacketMask active;
+};
+
+// Packet version of Aabb::Intersect. Returns the active lanes that enter the
+// box before their max_distance.
+inline PacketMask IntersectPacket(const Aabb &box, const RayPacket &packet,
+                                  const PacketFloat &max_distance) {
+  PacketFloat entry(0.f);
+  PacketFloat exit = max_distance;
+
+  for (int i = 0; i != 3; ++i) {
+    PacketFloat near = (PacketFloat(box.min[i]) - packet.origin[i]) *
+                       packet.inverse_direction[i];
+    PacketFloat far = (PacketFloat(box.max[i]) - packet.origin[i]) *
+                      packet.inverse_direction[i];
+
+    PacketMask is_swapped = near > far;
+    PacketFloat lane_near = Select(is_swapped, far, near);
+    PacketFloat lane_far = Select(is_swapped, near, far);
+
+    // Same NaN handling as the scalar test: a NaN bound changes nothing.
+    entry = Select(lane_near > entry, lane_near, entry);
+    exit = Select(lane_far < exit, lane_far, exit);
+  }
+
+  return (entry <= exit) & packet.active;
+}
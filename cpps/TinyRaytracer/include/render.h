@@ -24,9 +24,97 @@
 
 #pragma once
 
+#include <functional>
+
+#include "./environment_map.h"
 #include "./geometry/vec.h"
 #include "./image.h"
+#include "./ray_counters.h"
+#include "./scene.h"
+
+// Counters collected over one Render() call.
+struct RenderStats {
+  long long primary_ray_count = 0;
+  // Pixels that adaptive sampling gave more than the initial samples.
+  long long refined_pixel_count = 0;
+  long long shadow_ray_count = 0;
+  // Shadow rays answered by the per-light cache of the last occluder, without
+  // a BVH traversal.
+  long long shadow_cache_hit_count = 0;
+
+  // Wavefront mode only. Packets of kPacketSize reflection rays whose
+  // directions point into more than one octant, once in the order the rays
+  // were spawned and once in the order they were traced. The latter is lower
+  // when sort_reflection_rays is set.
+  long long queued_divergent_packet_count = 0;
+  long long traced_divergent_packet_count = 0;
+
+  // Reflection rays, intersection tests and more, counted by every worker
+  // and merged. Left at zero unless built with TINY_RAYTRACER_STATS.
+  RayCounters counters;
+};
+
+struct RenderOptions {
+  // Number of worker threads. 0 uses GetDefaultThreadCount().
+  int thread_count = 0;
+  // Trace primary rays in SIMD packets of kPacketSize. The image is the same
+  // either way.
+  bool use_ray_packets = true;
+  // Trace the samples of a tile stage by stage: all primary rays, then all
+  // shadow rays, then all reflection rays and so on, each stage in bulk.
+  // Otherwise every sample is followed through all of its bounces before
+  // the next one starts. The image is the same either way.
+  bool use_wavefront = false;
+  // Wavefront mode only: sort every queue of reflection rays by direction
+  // octant and origin before tracing it, so that the rays of a packet take
+  // similar paths through the scene. The image is the same either way.
+  bool sort_reflection_rays = false;
+
+  // Adaptive anti-aliasing. Every pixel first gets initial_sample_count
+  // samples, stratified over the pixel; a single one goes through its center.
+  // Pixels whose samples hit different shapes, or whose luminance variance is
+  // above variance_threshold, then get max_sample_count samples in total.
+  // Samples only depend on the pixel, so the image is the same for any
+  // thread count.
+  int initial_sample_count = 1;
+  int max_sample_count = 1;
+  // Luminance is in [0, 1], so the variance is at most 0.25.
+  float variance_threshold = 0.002f;
+  // Upper bound of primary rays per frame, or 0 for none. The initial samples
+  // are always taken; the refined pixels are chosen to fit in what remains.
+  long long max_primary_ray_count = 0;
+
+  // The shapes to render, built with Scene::Build(). When null, the scene of
+  // CreateDefaultScene() is rendered.
+  const Scene *scene = nullptr;
+  // Receives the counters of the render when not null.
+  RenderStats *stats = nullptr;
+  // Receives a heatmap of the time spent on every pixel, shadow rays and
+  // reflections included, when not null. Brighter is slower. Timing needs
+  // every sample traced on its own, so packets and the wavefront mode are
+  // not used then; the image stays the same.
+  Image<GrayscaleColor> *cost_image = nullptr;
+};
+
+// The spheres and the plane the raytracer shows by default, ready to render.
+// Add more shapes and call Scene::Build() again to extend it.
+Scene CreateDefaultScene();
 
 Image<RgbaColor> Render(int width, int height, float y_fov,
                         const Vec<3, float> camera_position,
-                        const Image<RgbaColor> &background_image);
+                        const EnvironmentMap &environment,
+                        const RenderOptions &options = {});
+
+// Renders the same image as Render() in passes of increasing resolution: the
+// first traces every 8th pixel in both directions, the next ones halve the
+// spacing until every pixel has been traced once. No pixel is traced twice.
+// on_pass receives the image after every pass, with the pixels not traced
+// yet filled from their nearest traced neighbour above and to the left. With
+// adaptive sampling, one more pass adds the extra samples at the end. on_pass
+// is called on the calling thread, and the returned image equals the last
+// one passed to it.
+Image<RgbaColor> RenderProgressive(
+    int width, int height, float y_fov, const Vec<3, float> camera_position,
+    const EnvironmentMap &environment,
+    const std::function<void(const Image<RgbaColor> &)> &on_pass,
+    const RenderOptions &options = {});
@@ -0,0 +1,74 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// Deterministic random numbers for pixel sampling. Every value is a hash of
+// the pixel, the sample index and the dimension, so a sample does not depend
+// on which thread traces it or on what was traced before it.
+inline uint32_t HashSample(int i, int j, int sample_index, int dimension) {
+  uint32_t hash = static_cast<uint32_t>(i) * 0x8da6b343u ^
+                  static_cast<uint32_t>(j) * 0xd8163841u ^
+                  static_cast<uint32_t>(sample_index) * 0xcb1ab31fu ^
+                  static_cast<uint32_t>(dimension) * 0x165667b1u;
+
+  // Finalizer of MurmurHash3.
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+// Uniform in [0, 1).
+inline float GetSampleRandom(int i, int j, int sample_index, int dimension) {
+  return (HashSample(i, j, sample_index, dimension) >> 8) * 0x1p-24f;
+}
+
+// Position of sample stratum_index out of stratum_count inside pixel (i, j),
+// as an offset in [0, 1) from its top-left corner. The pixel is split into a
+// grid of exactly stratum_count cells of the same area, and the sample is
+// jittered inside its own cell, so that any number of samples covers the
+// whole pixel evenly. The grid has as many rows as the largest divisor of
+// stratum_count that is not above its square root; a prime count gets a
+// single row of columns.
+inline void GetStratifiedSample(int i, int j, int sample_index,
+                                int stratum_index, int stratum_count,
+                                float &x, float &y) {
+  int row_count =
+      static_cast<int>(std::sqrt(static_cast<float>(stratum_count)));
+  while (row_count > 1 && stratum_count % row_count != 0) {
+    --row_count;
+  }
+  const int column_count = stratum_count / row_count;
+
+  x = (stratum_index % column_count + GetSampleRandom(i, j, sample_index, 0)) /
+      column_count;
+  y = (stratum_index / column_count + GetSampleRandom(i, j, sample_index, 1)) /
+      row_count;
+}
@@ -0,0 +1,233 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "./aabb.h"
+#include "./bvh.h"
+#include "./material.h"
+#include "./ray_packet.h"
+#include "./shape.h"
+#include "./triangle_mesh.h"
+#include "geometry/mat.h"
+#include "geometry/vec.h"
+
+enum class PrimitiveType { kSphere, kPlane, kMesh, kInstance };
+
+// Everything shading needs to know about the nearest hit of a ray. index is
+// -1 when nothing was hit, and the other fields are then left unset.
+struct HitRecord {
+  float distance;
+  Vec<3, float> point;
+  Vec<3, float> normal;
+  // Index into the material table of the scene, see Scene::GetMaterial().
+  int material_id;
+
+  PrimitiveType type;
+  int index;
+  // Order in which the shape was added to the scene. Ties between equally
+  // near primitives go to the lowest id, as in a linear scan over the shapes.
+  int shape_id;
+
+  // Instances only: the primitive hit inside the instanced scene.
+  PrimitiveType object_type;
+  int object_index;
+
+  // Meshes, also inside instances: the triangle hit and the barycentric
+  // weights of its second and third vertex.
+  int triangle;
+  float u;
+  float v;
+};
+
+// The primitive that blocked the previous shadow ray towards one light. Each
+// thread keeps one per light: neighbouring shadow rays tend to be blocked by
+// the same primitive, so testing it first often answers the query without a
+// traversal. index is -1 while nothing is cached.
+struct OccluderCache {
+  PrimitiveType type = PrimitiveType::kSphere;
+  int index = -1;
+
+  long long query_count = 0;
+  // Queries answered by the cached primitive alone.
+  long long hit_count = 0;
+};
+
+// Spheres as a structure of arrays, kept in the leaf order of their BVH.
+struct SphereArrays {
+  std::vector<float> center_x;
+  std::vector<float> center_y;
+  std::vector<float> center_z;
+  std::vector<float> radius;
+  std::vector<float> radius_squared;
+  std::vector<int> material_ids;
+  std::vector<int> shape_ids;
+};
+
+// Planes as a structure of arrays, kept in the leaf order of their BVH.
+struct PlaneArrays {
+  std::vector<float> center_x;
+  std::vector<float> center_y;
+  std::vector<float> center_z;
+  std::vector<float> normal_x;
+  std::vector<float> normal_y;
+  std::vector<float> normal_z;
+  std::vector<float> half_width;
+  std::vector<float> half_height;
+  std::vector<int> material_ids;
+  std::vector<int> shape_ids;
+};
+
+// Meshes are shared rather than copied; every mesh has its own BVH below the
+// one over the meshes of the scene.
+struct MeshArrays {
+  std::vector<std::shared_ptr<const TriangleMesh>> meshes;
+  std::vector<int> material_ids;
+  std::vector<int> shape_ids;
+};
+
+class Scene;
+
+// Instances place a shared scene with their own transform. They keep the
+// transforms only, so memory grows with the instance count by a few matrices
+// rather than by the instanced geometry.
+struct InstanceArrays {
+  std::vector<std::shared_ptr<const Scene>> scenes;
+  // From world to object space.
+  std::vector<Mat<4, 4, float>> inverse_transforms;
+  // From object space normals to world space normals.
+  std::vector<Mat<3, 3, float>> normal_transforms;
+  // Where the materials of the instanced scene start in the material table.
+  std::vector<int> material_offsets;
+  std::vector<int> shape_ids;
+};
+
+// The shapes of a render compiled for tracing. Every primitive type has its
+// own structure of arrays and its own BVH, and the arrays are sorted so that
+// a BVH leaf is a contiguous run. Intersection loops therefore stream through
+// memory without any virtual call.
+class Scene {
+ public:
+  void Add(const Sphere &sphere);
+  void Add(const Plane &plane);
+  void Add(std::shared_ptr<const TriangleMesh> mesh);
+  // Adds an instance of a built scene, placed by an affine transform from its
+  // space to this one. Its primitives count as one shape here. Instanced
+  // scenes cannot contain instances themselves.
+  void Add(std::shared_ptr<const Scene> scene,
+           const Mat<4, 4, float> &transform);
+
+  // Builds the BVHs and sorts the primitives into leaf order. Call it after
+  // the last Add(), and again after adding more shapes.
+  void Build();
+
+  // Finds the nearest primitive within max_distance and fills the hit record
+  // for it. Returns false and sets hit.index to -1 when there is none.
+  bool Intersect(const Vec<3, float> &origin, const Vec<3, float> &direction,
+                 float max_distance, HitRecord &hit) const;
+
+  // Intersect() for every active lane of a packet.
+  void IntersectPacket(const RayPacket &packet,
+                       const PacketFloat &max_distance,
+                       HitRecord (&hits)[kPacketSize]) const;
+
+  // Whether any primitive other than the ignored one lies on the ray within
+  // max_distance. Stops at the first one found. With a cache, its primitive
+  // is tested before anything else and replaced by the occluder found.
+  bool IsOccluded(const Vec<3, float> &origin, const Vec<3, float> &direction,
+                  float max_distance, const HitRecord &ignored,
+                  OccluderCache *cache = nullptr) const;
+
+  // IsOccluded() for every active lane of a packet, each lane with its own
+  // ignored primitive. Returns the occluded lanes. The cache is shared by
+  // the lanes and counts one query per active lane.
+  PacketMask IsOccludedPacket(const RayPacket &packet,
+                              const PacketFloat &max_distance,
+                              const HitRecord (&ignored)[kPacketSize],
+                              OccluderCache *cache = nullptr) const;
+
+  const MaterialVariant &GetMaterial(int material_id) const {
+    return _materials[material_id];
+  }
+
+  // Bounds of all primitives as of the last Build().
+  const Aabb &GetBounds() const { return _bounds; }
+
+ private:
+  int AddMaterial(const MaterialVariant &material);
+  // ignored only matters for meshes, whose other triangles can still occlude.
+  bool IntersectsPrimitive(PrimitiveType type, int index,
+                           const Vec<3, float> &origin,
+                           const Vec<3, float> &direction, float max_distance,
+                           const HitRecord &ignored) const;
+  // IntersectsPrimitive() for the active lanes of a packet, leaving out the
+  // lanes that ignore the primitive.
+  PacketMask IntersectsPrimitivePacket(
+      PrimitiveType type, int index, const RayPacket &packet,
+      const PacketFloat &max_distance,
+      const HitRecord (&ignored)[kPacketSize]) const;
+  // Intersects the meshes for a single ray, narrowing nearest_distance.
+  void IntersectMeshes(const Vec<3, float> &origin,
+                       const Vec<3, float> &direction, float &nearest_distance,
+                       HitRecord &hit) const;
+  // Intersects the instances for a single ray, narrowing nearest_distance.
+  // Instance hits get their normal and material_id right away, while the
+  // ray is still in object space.
+  void IntersectInstances(const Vec<3, float> &origin,
+                          const Vec<3, float> &direction,
+                          float &nearest_distance, HitRecord &hit) const;
+  // Transforms a ray into the space of an instance. The object space
+  // direction is normalized again, and distances along it are scale times
+  // those along the world space ray.
+  void GetObjectRay(int instance, const Vec<3, float> &origin,
+                    const Vec<3, float> &direction,
+                    Vec<3, float> &object_origin,
+                    Vec<3, float> &object_direction, float &scale) const;
+  // Fills point, normal and material_id once the nearest hit is known.
+  void FillSurface(const Vec<3, float> &origin, const Vec<3, float> &direction,
+                   HitRecord &hit) const;
+
+  SphereArrays _spheres;
+  PlaneArrays _planes;
+  MeshArrays _meshes;
+  InstanceArrays _instances;
+  std::vector<Aabb> _sphere_bounds;
+  std::vector<Aabb> _plane_bounds;
+  std::vector<Aabb> _mesh_bounds;
+  std::vector<Aabb> _instance_bounds;
+  Bvh _sphere_bvh;
+  Bvh _plane_bvh;
+  Bvh _mesh_bvh;
+  Bvh _instance_bvh;
+  Aabb _bounds;
+  std::vector<MaterialVariant> _materials;
+  // Instanced scenes whose materials are already in _materials, with the
+  // position of their first material.
+  std::vector<std::pair<const Scene *, int>> _instanced_material_offsets;
+  int _shape_count = 0;
+};
@@ -24,23 +24,35 @@
 
 #pragma once
 
+#include "./aabb.h"
 #include "./image.h"
 #include "./material.h"
+#include "./ray_packet.h"
 #include "geometry/vec.h"
 
 class Shape {
  public:
   explicit Shape(const MaterialVariant &material) : _material(material) {}
 
-  MaterialVariant GetMaterial() const { return _material; }
+  const MaterialVariant &GetMaterial() const { return _material; }
   virtual float GetIntersectionDistance(const Vec<3, float> &origin,
                                         const Vec<3, float> &direction,
                                         float rayLength) const {
     throw std::runtime_error("GetIntersectionDistance is not implemented.");
   }
+  // Lane by lane the same result as GetIntersectionDistance, for a whole
+  // packet of normalized rays.
+  virtual PacketFloat GetPacketIntersectionDistances(
+      const RayPacket &packet, const PacketFloat &ray_length) const {
+    throw std::runtime_error(
+        "GetPacketIntersectionDistances is not implemented.");
+  }
   virtual Vec<3, float> GetNormal(const Vec<3, float> &point) const {
     throw std::runtime_error("GetNormal is not implemented.");
   }
+  virtual Aabb GetBounds() const {
+    throw std::runtime_error("GetBounds is not implemented.");
+  }
 
  protected:
   MaterialVariant _material;
@@ -68,12 +80,18 @@ class Sphere : public Shape {
   float GetIntersectionDistance(const Vec<3, float> &origin,
                                 const Vec<3, float> &direction,
                                 float rayLength) const override;
+  PacketFloat GetPacketIntersectionDistances(
+      const RayPacket &packet, const PacketFloat &ray_length) const override;
 
   Vec<3, float> GetNormal(const Vec<3, float> &point) const override {
     return (point - _center).Normalize();
   }
 
+  Aabb GetBounds() const override;
+
  private:
+  friend class Scene;
+
   float _radius;
   Vec<3, float> _center;
 };
@@ -115,12 +133,18 @@ class Plane : public Shape {
   float GetIntersectionDistance(const Vec<3, float> &origin,
                                 const Vec<3, float> &direction,
                                 float rayLength) const override;
+  PacketFloat GetPacketIntersectionDistances(
+      const RayPacket &packet, const PacketFloat &ray_length) const override;
 
   Vec<3, float> GetNormal(const Vec<3, float> &point) const override {
     return _normal;
   }
 
+  Aabb GetBounds() const override;
+
  private:
+  friend class Scene;
+
   Vec<3, float> _normal;
   Vec<3, float> _center;
   float _width;
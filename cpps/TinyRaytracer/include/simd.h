@@ -0,0 +1,374 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// A float per lane for ray packets. The width follows the instruction set the
+// code is compiled for: 8 lanes with AVX, 4 with SSE2 and 4 plain floats
+// everywhere else, so callers only ever loop up to kPacketSize.
+#if defined(__AVX__)
+#include <immintrin.h>
+constexpr int kPacketSize = 8;
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+constexpr int kPacketSize = 4;
+#else
+constexpr int kPacketSize = 4;
+#endif
+
+#if defined(__AVX__)
+
+class PacketMask {
+ public:
+  PacketMask() : _value(_mm256_setzero_ps()) {}
+  explicit PacketMask(__m256 value) : _value(value) {}
+
+  static PacketMask FromBits(int bits) {
+    __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i selected = _mm256_and_si256(_mm256_set1_epi32(bits), lanes);
+    return PacketMask(
+        _mm256_castsi256_ps(_mm256_cmpeq_epi32(selected, lanes)));
+  }
+
+  int GetBits() const { return _mm256_movemask_ps(_value); }
+  bool Any() const { return GetBits() != 0; }
+
+  PacketMask operator&(const PacketMask &other) const {
+    return PacketMask(_mm256_and_ps(_value, other._value));
+  }
+  PacketMask operator|(const PacketMask &other) const {
+    return PacketMask(_mm256_or_ps(_value, other._value));
+  }
+  // this & ~other
+  PacketMask AndNot(const PacketMask &other) const {
+    return PacketMask(_mm256_andnot_ps(other._value, _value));
+  }
+
+  __m256 GetNative() const { return _value; }
+
+ private:
+  __m256 _value;
+};
+
+class PacketFloat {
+ public:
+  PacketFloat() : _value(_mm256_setzero_ps()) {}
+  explicit PacketFloat(float value) : _value(_mm256_set1_ps(value)) {}
+  explicit PacketFloat(__m256 value) : _value(value) {}
+
+  static PacketFloat Load(const float *values) {
+    return PacketFloat(_mm256_loadu_ps(values));
+  }
+  void Store(float *values) const { _mm256_storeu_ps(values, _value); }
+  // Converts to integers, rounding towards zero.
+  void StoreTruncated(int32_t *values) const {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(values),
+                        _mm256_cvttps_epi32(_value));
+  }
+
+  PacketFloat operator+(const PacketFloat &o) const {
+    return PacketFloat(_mm256_add_ps(_value, o._value));
+  }
+  PacketFloat operator-(const PacketFloat &o) const {
+    return PacketFloat(_mm256_sub_ps(_value, o._value));
+  }
+  PacketFloat operator*(const PacketFloat &o) const {
+    return PacketFloat(_mm256_mul_ps(_value, o._value));
+  }
+  PacketFloat operator/(const PacketFloat &o) const {
+    return PacketFloat(_mm256_div_ps(_value, o._value));
+  }
+
+  PacketMask operator<(const PacketFloat &o) const {
+    return PacketMask(_mm256_cmp_ps(_value, o._value, _CMP_LT_OQ));
+  }
+  PacketMask operator<=(const PacketFloat &o) const {
+    return PacketMask(_mm256_cmp_ps(_value, o._value, _CMP_LE_OQ));
+  }
+  PacketMask operator>(const PacketFloat &o) const {
+    return PacketMask(_mm256_cmp_ps(_value, o._value, _CMP_GT_OQ));
+  }
+  PacketMask operator>=(const PacketFloat &o) const {
+    return PacketMask(_mm256_cmp_ps(_value, o._value, _CMP_GE_OQ));
+  }
+  PacketMask operator==(const PacketFloat &o) const {
+    return PacketMask(_mm256_cmp_ps(_value, o._value, _CMP_EQ_OQ));
+  }
+
+  friend PacketFloat Sqrt(const PacketFloat &a) {
+    return PacketFloat(_mm256_sqrt_ps(a._value));
+  }
+  friend PacketFloat Abs(const PacketFloat &a) {
+    return PacketFloat(_mm256_andnot_ps(_mm256_set1_ps(-0.f), a._value));
+  }
+  friend PacketFloat Min(const PacketFloat &a, const PacketFloat &b) {
+    return PacketFloat(_mm256_min_ps(a._value, b._value));
+  }
+  friend PacketFloat Max(const PacketFloat &a, const PacketFloat &b) {
+    return PacketFloat(_mm256_max_ps(a._value, b._value));
+  }
+  // Lanes set in mask take a, the others take b.
+  friend PacketFloat Select(const PacketMask &mask, const PacketFloat &a,
+                            const PacketFloat &b) {
+    return PacketFloat(_mm256_blendv_ps(b._value, a._value, mask.GetNative()));
+  }
+
+ private:
+  __m256 _value;
+};
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+class PacketMask {
+ public:
+  PacketMask() : _value(_mm_setzero_ps()) {}
+  explicit PacketMask(__m128 value) : _value(value) {}
+
+  static PacketMask FromBits(int bits) {
+    __m128i lanes = _mm_setr_epi32(1, 2, 4, 8);
+    __m128i selected = _mm_and_si128(_mm_set1_epi32(bits), lanes);
+    return PacketMask(_mm_castsi128_ps(_mm_cmpeq_epi32(selected, lanes)));
+  }
+
+  int GetBits() const { return _mm_movemask_ps(_value); }
+  bool Any() const { return GetBits() != 0; }
+
+  PacketMask operator&(const PacketMask &other) const {
+    return PacketMask(_mm_and_ps(_value, other._value));
+  }
+  PacketMask operator|(const PacketMask &other) const {
+    return PacketMask(_mm_or_ps(_value, other._value));
+  }
+  // this & ~other
+  PacketMask AndNot(const PacketMask &other) const {
+    return PacketMask(_mm_andnot_ps(other._value, _value));
+  }
+
+  __m128 GetNative() const { return _value; }
+
+ private:
+  __m128 _value;
+};
+
+class PacketFloat {
+ public:
+  PacketFloat() : _value(_mm_setzero_ps()) {}
+  explicit PacketFloat(float value) : _value(_mm_set1_ps(value)) {}
+  explicit PacketFloat(__m128 value) : _value(value) {}
+
+  static PacketFloat Load(const float *values) {
+    return PacketFloat(_mm_loadu_ps(values));
+  }
+  void Store(float *values) const { _mm_storeu_ps(values, _value); }
+  // Converts to integers, rounding towards zero.
+  void StoreTruncated(int32_t *values) const {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(values),
+                     _mm_cvttps_epi32(_value));
+  }
+
+  PacketFloat operator+(const PacketFloat &o) const {
+    return PacketFloat(_mm_add_ps(_value, o._value));
+  }
+  PacketFloat operator-(const PacketFloat &o) const {
+    return PacketFloat(_mm_sub_ps(_value, o._value));
+  }
+  PacketFloat operator*(const PacketFloat &o) const {
+    return PacketFloat(_mm_mul_ps(_value, o._value));
+  }
+  PacketFloat operator/(const PacketFloat &o) const {
+    return PacketFloat(_mm_div_ps(_value, o._value));
+  }
+
+  PacketMask operator<(const PacketFloat &o) const {
+    return PacketMask(_mm_cmplt_ps(_value, o._value));
+  }
+  PacketMask operator<=(const PacketFloat &o) const {
+    return PacketMask(_mm_cmple_ps(_value, o._value));
+  }
+  PacketMask operator>(const PacketFloat &o) const {
+    return PacketMask(_mm_cmpgt_ps(_value, o._value));
+  }
+  PacketMask operator>=(const PacketFloat &o) const {
+    return PacketMask(_mm_cmpge_ps(_value, o._value));
+  }
+  PacketMask operator==(const PacketFloat &o) const {
+    return PacketMask(_mm_cmpeq_ps(_value, o._value));
+  }
+
+  friend PacketFloat Sqrt(const PacketFloat &a) {
+    return PacketFloat(_mm_sqrt_ps(a._value));
+  }
+  friend PacketFloat Abs(const PacketFloat &a) {
+    return PacketFloat(_mm_andnot_ps(_mm_set1_ps(-0.f), a._value));
+  }
+  friend PacketFloat Min(const PacketFloat &a, const PacketFloat &b) {
+    return PacketFloat(_mm_min_ps(a._value, b._value));
+  }
+  friend PacketFloat Max(const PacketFloat &a, const PacketFloat &b) {
+    return PacketFloat(_mm_max_ps(a._value, b._value));
+  }
+  // Lanes set in mask take a, the others take b.
+  friend PacketFloat Select(const PacketMask &mask, const PacketFloat &a,
+                            const PacketFloat &b) {
+    __m128 native_mask = mask.GetNative();
+    return PacketFloat(_mm_or_ps(_mm_and_ps(native_mask, a._value),
+                                 _mm_andnot_ps(native_mask, b._value)));
+  }
+
+ private:
+  __m128 _value;
+};
+
+#else
+
+class PacketMask {
+ public:
+  PacketMask() : _bits(0) {}
+
+  static PacketMask FromBits(int bits) {
+    PacketMask mask;
+    mask._bits = bits & ((1 << kPacketSize) - 1);
+    return mask;
+  }
+
+  int GetBits() const { return _bits; }
+  bool Any() const { return _bits != 0; }
+
+  PacketMask operator&(const PacketMask &other) const {
+    return FromBits(_bits & other._bits);
+  }
+  PacketMask operator|(const PacketMask &other) const {
+    return FromBits(_bits | other._bits);
+  }
+  // this & ~other
+  PacketMask AndNot(const PacketMask &other) const {
+    return FromBits(_bits & ~other._bits);
+  }
+
+ private:
+  int _bits;
+};
+
+class PacketFloat {
+ public:
+  PacketFloat() : _values{} {}
+  explicit PacketFloat(float value) {
+    for (int i = 0; i != kPacketSize; ++i) _values[i] = value;
+  }
+
+  static PacketFloat Load(const float *values) {
+    PacketFloat result;
+    std::memcpy(result._values, values, sizeof(result._values));
+    return result;
+  }
+  void Store(float *values) const {
+    std::memcpy(values, _values, sizeof(_values));
+  }
+  // Converts to integers, rounding towards zero.
+  void StoreTruncated(int32_t *values) const {
+    for (int i = 0; i != kPacketSize; ++i) {
+      values[i] = static_cast<int32_t>(_values[i]);
+    }
+  }
+
+  template <class Function>
+  static PacketFloat Map(const PacketFloat &a, const PacketFloat &b,
+                         Function function) {
+    PacketFloat result;
+    for (int i = 0; i != kPacketSize; ++i) {
+      result._values[i] = function(a._values[i], b._values[i]);
+    }
+    return result;
+  }
+  template <class Function>
+  static PacketMask Compare(const PacketFloat &a, const PacketFloat &b,
+                            Function function) {
+    int bits = 0;
+    for (int i = 0; i != kPacketSize; ++i) {
+      bits |= function(a._values[i], b._values[i]) ? 1 << i : 0;
+    }
+    return PacketMask::FromBits(bits);
+  }
+
+  PacketFloat operator+(const PacketFloat &o) const {
+    return Map(*this, o, [](float a, float b) { return a + b; });
+  }
+  PacketFloat operator-(const PacketFloat &o) const {
+    return Map(*this, o, [](float a, float b) { return a - b; });
+  }
+  PacketFloat operator*(const PacketFloat &o) const {
+    return Map(*this, o, [](float a, float b) { return a * b; });
+  }
+  PacketFloat operator/(const PacketFloat &o) const {
+    return Map(*this, o, [](float a, float b) { return a / b; });
+  }
+
+  PacketMask operator<(const PacketFloat &o) const {
+    return Compare(*this, o, [](float a, float b) { return a < b; });
+  }
+  PacketMask operator<=(const PacketFloat &o) const {
+    return Compare(*this, o, [](float a, float b) { return a <= b; });
+  }
+  PacketMask operator>(const PacketFloat &o) const {
+    return Compare(*this, o, [](float a, float b) { return a > b; });
+  }
+  PacketMask operator>=(const PacketFloat &o) const {
+    return Compare(*this, o, [](float a, float b) { return a >= b; });
+  }
+  PacketMask operator==(const PacketFloat &o) const {
+    return Compare(*this, o, [](float a, float b) { return a == b; });
+  }
+
+  friend PacketFloat Sqrt(const PacketFloat &a) {
+    return Map(a, a, [](float x, float) { return std::sqrt(x); });
+  }
+  friend PacketFloat Abs(const PacketFloat &a) {
+    return Map(a, a, [](float x, float) { return std::fabs(x); });
+  }
+  friend PacketFloat Min(const PacketFloat &a, const PacketFloat &b) {
+    return Map(a, b, [](float x, float y) { return x < y ? x : y; });
+  }
+  friend PacketFloat Max(const PacketFloat &a, const PacketFloat &b) {
+    return Map(a, b, [](float x, float y) { return x > y ? x : y; });
+  }
+  // Lanes set in mask take a, the others take b.
+  friend PacketFloat Select(const PacketMask &mask, const PacketFloat &a,
+                            const PacketFloat &b) {
+    PacketFloat result;
+    for (int i = 0; i != kPacketSize; ++i) {
+      result._values[i] =
+          mask.GetBits() & (1 << i) ? a._values[i] : b._values[i];
+    }
+    return result;
+  }
+
+ private:
+  float _values[kPacketSize];
+};
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "./aabb.h"
+#include "./bvh.h"
+#include "./material.h"
+#include "./model.h"
+#include "./shape.h"
+#include "geometry/mat.h"
+#include "geometry/utils.h"
+#include "geometry/vec.h"
+
+// The nearest triangle a ray hit in a TriangleMesh.
+struct MeshHit {
+  float distance;
+  int triangle;
+  // Barycentric weights of the second and the third vertex.
+  float u;
+  float v;
+};
+
+// The faces of a Model as triangles with their own BVH, so that a ray costs
+// logarithmic rather than linear time in the triangle count. Polygons are
+// split into fans. The triangles are stored as structure of arrays in BVH
+// leaf order, and leaves hold up to kPacketSize triangles that are tested
+// against a ray all at once.
+class TriangleMesh : public Shape {
+ public:
+  // transform is applied to the vertices of the model once, here.
+  TriangleMesh(const MaterialVariant &material, const Model &model,
+               const Mat<4, 4, float> &transform = GetIdentityMat<4, float>());
+
+  int GetTriangleCount() const { return _triangle_count; }
+
+  // Finds the nearest triangle within max_distance. Returns false when there
+  // is none.
+  bool Intersect(const Vec<3, float> &origin, const Vec<3, float> &direction,
+                 float max_distance, MeshHit &hit) const;
+
+  // Whether any triangle but ignored_triangle lies on the ray within
+  // max_distance. Stops at the first one found.
+  bool IsOccluded(const Vec<3, float> &origin, const Vec<3, float> &direction,
+                  float max_distance, int ignored_triangle = -1) const;
+
+  // The vertex normals of a triangle, interpolated at a hit.
+  Vec<3, float> GetNormal(const MeshHit &hit) const;
+
+  float GetIntersectionDistance(const Vec<3, float> &origin,
+                                const Vec<3, float> &direction,
+                                float rayLength) const override;
+  Aabb GetBounds() const override { return _bounds; }
+
+ private:
+  int _triangle_count = 0;
+  // _vertices[v][axis][triangle]. Padded with kPacketSize degenerate
+  // triangles, so that a full packet can be loaded from any leaf.
+  std::vector<float> _vertices[3][3];
+  // _normals[v][axis][triangle].
+  std::vector<float> _normals[3][3];
+  Aabb _bounds;
+  Bvh _bvh;
+};
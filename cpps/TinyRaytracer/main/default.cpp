@@ -23,23 +23,107 @@
  * SOFTWARE.
  */
 
+#include <cmath>
 #include <iostream>
+#include <memory>
+#include <string>
 
 #include "file.h"
+#include "geometry/utils.h"
 #include "geometry/vec.h"
+#include "model.h"
 #include "render.h"
+#include "triangle_mesh.h"
+
+// Usage: TinyRaytracer [--cost] [model.obj]
+// The model, if given, is placed on the floor of the default scene a few
+// times. With --cost, a heatmap of the time spent per pixel is written to
+// ../result/cost.png as well.
+int main(int argc, char **argv) {
+  bool is_cost_image_written = false;
+  const char *model_path = nullptr;
+  for (int i = 1; i != argc; ++i) {
+    if (std::string(argv[i]) == "--cost") {
+      is_cost_image_written = true;
+    } else {
+      model_path = argv[i];
+    }
+  }
 
-int main() {
   int width = 1200;
   int height = 720;
 
   Image<RgbaColor> background_image =
       ReadJpg("../assets/rosendal_plains/rosendal_plains_2k.jpg");
+  EnvironmentMap environment(background_image);
+
+  RenderStats stats;
+  RenderOptions options;
+  options.initial_sample_count = 4;
+  options.max_sample_count = 16;
+  options.max_primary_ray_count = width * height * 6;
+  options.stats = &stats;
+
+  Image<GrayscaleColor> cost_image(width, height);
+  if (is_cost_image_written) {
+    options.cost_image = &cost_image;
+  }
 
-  Image<RgbaColor> result =
-      Render(width, height, 50, Vec<3, float>({0, 0, 1}), background_image);
+  Scene scene = CreateDefaultScene();
+  if (model_path != nullptr) {
+    // The model is loaded once and shared by all of its instances.
+    auto model_scene = std::make_shared<Scene>();
+    model_scene->Add(std::make_shared<TriangleMesh>(
+        SolidMaterial(RgbaColor(90, 110, 140)), Model(model_path)));
+    model_scene->Build();
+
+    const float kPlacements[][4] = {
+        // x, z, scale, rotation about y in radians
+        {0.9f, -2.8f, 0.5f, 0.f},
+        {-1.6f, -2.6f, 0.35f, 1.2f},
+        {0.1f, -1.9f, 0.25f, -0.8f},
+    };
+    for (const auto &[x, z, scale, angle] : kPlacements) {
+      Mat<4, 4, float> transform = GetIdentityMat<4, float>();
+      transform[0][0] = scale * std::cos(angle);
+      transform[0][2] = scale * std::sin(angle);
+      transform[2][0] = -scale * std::sin(angle);
+      transform[2][2] = scale * std::cos(angle);
+      transform[1][1] = scale;
+      transform[0][3] = x;
+      transform[1][3] = -1.05f;
+      transform[2][3] = z;
+      scene.Add(model_scene, transform);
+    }
+    scene.Build();
+  }
+  options.scene = &scene;
+
+  Image<RgbaColor> result = Render(width, height, 50, Vec<3, float>({0, 0, 1}),
+                                   environment, options);
 
   WritePng("../result/result.png", result);
+  if (is_cost_image_written) {
+    WritePng("../result/cost.png", cost_image);
+  }
+
+  std::cout << "Primary rays: " << stats.primary_ray_count << ", "
+            << stats.refined_pixel_count << " pixels refined" << std::endl;
+  std::cout << "Shadow rays: " << stats.shadow_ray_count
+            << ", answered by the occluder cache: "
+            << stats.shadow_cache_hit_count << std::endl;
+  if constexpr (kCountRays) {
+    const RayCounters &counters = stats.counters;
+    std::cout << "Reflection rays: " << counters.reflection_ray_count
+              << ", deepest path: " << counters.max_depth << " reflections"
+              << std::endl;
+    std::cout << "Intersection tests: " << counters.sphere_test_count
+              << " spheres, " << counters.plane_test_count << " planes, "
+              << counters.triangle_test_count << " triangles, "
+              << counters.instance_test_count << " instances" << std::endl;
+    std::cout << "Background lookups: " << counters.background_lookup_count
+              << std::endl;
+  }
 
   return 0;
 }
\ No newline at end of file
@@ -25,15 +25,36 @@
 
 #include <emscripten/bind.h>
 
+#include <algorithm>
+#include <memory>
+#include <utility>
+
 #include "file.h"
 #include "geometry/vec.h"
 #include "render.h"
 
 void render(int width, int height) {
-  Image<RgbaColor> background_image = ReadJpg("background.jpg");
+  // The page writes the background the user picked to background.jpg
+  // before every call. Converting it to a cube map is costly, so the map is
+  // kept and only built again when the image differs from the last one.
+  static Image<RgbaColor> background_image;
+  static std::unique_ptr<EnvironmentMap> environment;
+
+  Image<RgbaColor> image = ReadJpg("background.jpg");
+  if (!environment || image.GetWidth() != background_image.GetWidth() ||
+      image.GetHeight() != background_image.GetHeight() ||
+      !std::equal(image.GetData().begin(), image.GetData().end(),
+                  background_image.GetData().begin(),
+                  [](const RgbaColor& a, const RgbaColor& b) {
+                    return a.r == b.r && a.g == b.g && a.b == b.b &&
+                           a.a == b.a;
+                  })) {
+    environment = std::make_unique<EnvironmentMap>(image);
+    background_image = std::move(image);
+  }
 
   Image<RgbaColor> result =
-      Render(width, height, 50, Vec<3, float>({0, 0, 1}), background_image);
+      Render(width, height, 50, Vec<3, float>({0, 0, 1}), *environment);
 
   WritePng("output.png", result);
 }
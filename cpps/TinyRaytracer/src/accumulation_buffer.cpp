@@ -0,0 +1,86 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "./accumulation_buffer.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "./simd.h"
+
+namespace {
+
+// Clamps radiance to what an 8-bit channel can show and rounds it to the
+// nearest level.
+PacketFloat Quantize(const PacketFloat &radiance) {
+  return Min(Max(radiance, PacketFloat(0.f)), PacketFloat(1.f)) *
+             PacketFloat(255.f) +
+         PacketFloat(0.5f);
+}
+
+}  // namespace
+
+void AccumulationBuffer::Resolve(Image<RgbaColor> &image) const {
+  const int pixel_count = _width * _height;
+
+  for (int first = 0; first < pixel_count; first += kPacketSize) {
+    const int count = std::min(kPacketSize, pixel_count - first);
+
+    // The last packet may run past the end of the planes.
+    float counts[kPacketSize];
+    float red_sums[kPacketSize];
+    float green_sums[kPacketSize];
+    float blue_sums[kPacketSize];
+    for (int lane = 0; lane != kPacketSize; ++lane) {
+      const int index = first + (lane < count ? lane : 0);
+      counts[lane] = static_cast<float>(_sample_counts[index]);
+      red_sums[lane] = _red_sums[index];
+      green_sums[lane] = _green_sums[index];
+      blue_sums[lane] = _blue_sums[index];
+    }
+
+    // Pixels without samples divide by 1 instead of 0 and are skipped below.
+    const PacketFloat inverse_counts =
+        PacketFloat(1.f) / Max(PacketFloat::Load(counts), PacketFloat(1.f));
+
+    int32_t red[kPacketSize];
+    int32_t green[kPacketSize];
+    int32_t blue[kPacketSize];
+    Quantize(PacketFloat::Load(red_sums) * inverse_counts).StoreTruncated(red);
+    Quantize(PacketFloat::Load(green_sums) * inverse_counts)
+        .StoreTruncated(green);
+    Quantize(PacketFloat::Load(blue_sums) * inverse_counts)
+        .StoreTruncated(blue);
+
+    for (int lane = 0; lane != count; ++lane) {
+      const int index = first + lane;
+      if (_sample_counts[index] == 0) {
+        continue;
+      }
+
+      image.set(index % _width, index / _width,
+                RgbaColor(red[lane], green[lane], blue[lane]));
+    }
+  }
+}
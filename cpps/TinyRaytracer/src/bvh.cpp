@@ -0,0 +1,177 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "./bvh.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+namespace {
+
+const int kBinCount = 12;
+
+// Past this depth nodes are split at the median so that the traversal stack
+// can never overflow, whatever the primitive distribution.
+const int kMaxSahDepth = 32;
+
+struct Bin {
+  Aabb bounds;
+  int count = 0;
+};
+
+}  // namespace
+
+Bvh::Bvh(const std::vector<Aabb> &primitive_bounds, int max_leaf_size)
+    : _max_leaf_size(max_leaf_size) {
+  std::vector<Vec<3, float>> centers(primitive_bounds.size());
+  std::vector<int> unbounded_primitive_indices;
+
+  for (int i = 0; i != primitive_bounds.size(); ++i) {
+    if (!primitive_bounds[i].IsFinite()) {
+      unbounded_primitive_indices.push_back(i);
+      continue;
+    }
+
+    centers[i] = primitive_bounds[i].GetCenter();
+    _primitive_indices.push_back(i);
+  }
+
+  _bounded_count = _primitive_indices.size();
+
+  if (_bounded_count > 0) {
+    _nodes.reserve(2 * _bounded_count);
+    _nodes.push_back(BvhNode());
+    Build(0, 0, _bounded_count, 0, primitive_bounds, centers);
+  }
+
+  _primitive_indices.insert(_primitive_indices.end(),
+                            unbounded_primitive_indices.begin(),
+                            unbounded_primitive_indices.end());
+}
+
+void Bvh::Build(int node_index, int first, int count, int depth,
+                const std::vector<Aabb> &primitive_bounds,
+                const std::vector<Vec<3, float>> &centers) {
+  Aabb bounds;
+  Aabb center_bounds;
+  for (int i = first; i != first + count; ++i) {
+    bounds.Extend(primitive_bounds[_primitive_indices[i]]);
+    center_bounds.Extend(centers[_primitive_indices[i]]);
+  }
+
+  _nodes[node_index].bounds = bounds;
+  _nodes[node_index].first = first;
+  _nodes[node_index].count = count;
+
+  if (count <= _max_leaf_size) {
+    return;
+  }
+
+  Vec<3, float> center_extent = center_bounds.max - center_bounds.min;
+  int axis = 0;
+  if (center_extent[1] > center_extent[axis]) axis = 1;
+  if (center_extent[2] > center_extent[axis]) axis = 2;
+
+  auto begin = _primitive_indices.begin() + first;
+  auto end = begin + count;
+  auto middle = begin + count / 2;
+
+  if (center_extent[axis] <= 0 || depth >= kMaxSahDepth) {
+    // All centers coincide or the tree got deep: split by count.
+    std::nth_element(begin, middle, end, [&](int a, int b) {
+      return centers[a][axis] < centers[b][axis];
+    });
+  } else {
+    float bin_scale = kBinCount / center_extent[axis];
+    auto get_bin_index = [&](int primitive_index) {
+      int bin_index = static_cast<int>(
+          (centers[primitive_index][axis] - center_bounds.min[axis]) *
+          bin_scale);
+      return std::min(bin_index, kBinCount - 1);
+    };
+
+    std::array<Bin, kBinCount> bins;
+    for (auto it = begin; it != end; ++it) {
+      Bin &bin = bins[get_bin_index(*it)];
+      bin.bounds.Extend(primitive_bounds[*it]);
+      ++bin.count;
+    }
+
+    // Sweep from the right to get the cost of every right-hand side, then
+    // from the left to find the cheapest split.
+    std::array<float, kBinCount> right_costs;
+    Aabb right_bounds;
+    int right_count = 0;
+    for (int i = kBinCount - 1; i > 0; --i) {
+      right_bounds.Extend(bins[i].bounds);
+      right_count += bins[i].count;
+      right_costs[i] = right_count > 0
+                           ? right_bounds.GetSurfaceArea() * right_count
+                           : 0;
+    }
+
+    int best_split = -1;
+    float best_cost = std::numeric_limits<float>::max();
+    Aabb left_bounds;
+    int left_count = 0;
+    for (int i = 1; i != kBinCount; ++i) {
+      left_bounds.Extend(bins[i - 1].bounds);
+      left_count += bins[i - 1].count;
+      if (left_count == 0 || left_count == count) {
+        continue;
+      }
+
+      float cost = left_bounds.GetSurfaceArea() * left_count + right_costs[i];
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_split = i;
+      }
+    }
+
+    if (best_split == -1) {
+      std::nth_element(begin, middle, end, [&](int a, int b) {
+        return centers[a][axis] < centers[b][axis];
+      });
+    } else {
+      middle = std::partition(begin, end, [&](int primitive_index) {
+        return get_bin_index(primitive_index) < best_split;
+      });
+    }
+  }
+
+  int left_count = middle - begin;
+
+  int left_index = _nodes.size();
+  _nodes.push_back(BvhNode());
+  Build(left_index, first, left_count, depth + 1, primitive_bounds, centers);
+
+  int right_index = _nodes.size();
+  _nodes.push_back(BvhNode());
+  Build(right_index, first + left_count, count - left_count, depth + 1,
+        primitive_bounds, centers);
+
+  _nodes[node_index].first = right_index;
+  _nodes[node_index].count = 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "./environment_map.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Direction through position (s, t) in [-1, 1]^2 of a face. The inverse of
+// the face selection in EnvironmentMap::Lookup().
+Vec<3, float> GetFaceDirection(int face, float s, float t) {
+  switch (face) {
+    case 0:
+      return Vec<3, float>({1, -t, -s});
+    case 1:
+      return Vec<3, float>({-1, -t, s});
+    case 2:
+      return Vec<3, float>({s, 1, t});
+    case 3:
+      return Vec<3, float>({s, -1, -t});
+    case 4:
+      return Vec<3, float>({s, -t, 1});
+    default:
+      return Vec<3, float>({-s, -t, -1});
+  }
+}
+
+// Bilinearly filtered texel of a latitude-longitude image in direction. The
+// mapping is the one the raytracer has always used for its background.
+Radiance SampleLatLong(const Image<RgbaColor> &image,
+                       const Vec<3, float> &direction) {
+  const int width = image.GetWidth();
+  const int height = image.GetHeight();
+
+  float u = std::atan2(direction[0], -direction[2]) / (kPi * 2) + 0.5f;
+  float v = 1.0f - std::acos(direction[1]) / kPi;
+
+  float x = u * width - 0.5f;
+  float y = std::clamp(v * height - 0.5f, 0.f, height - 1.f);
+
+  int x0 = static_cast<int>(std::floor(x));
+  int y0 = static_cast<int>(y);
+  float x_ratio = x - x0;
+  float y_ratio = y - y0;
+
+  // Longitude wraps around, latitude stops at the poles.
+  x0 = (x0 % width + width) % width;
+  int x1 = (x0 + 1) % width;
+  int y1 = std::min(y0 + 1, height - 1);
+
+  const std::vector<RgbaColor> &data = image.GetData();
+  Radiance radiance00(data[y0 * width + x0]);
+  Radiance radiance10(data[y0 * width + x1]);
+  Radiance radiance01(data[y1 * width + x0]);
+  Radiance radiance11(data[y1 * width + x1]);
+
+  return (radiance00 * (1 - x_ratio) + radiance10 * x_ratio) * (1 - y_ratio) +
+         (radiance01 * (1 - x_ratio) + radiance11 * x_ratio) * y_ratio;
+}
+
+uint8_t Quantize(float value) {
+  return static_cast<uint8_t>(std::clamp(value, 0.f, 1.f) * 255 + 0.5f);
+}
+
+}  // namespace
+
+EnvironmentMap::EnvironmentMap(const Image<RgbaColor> &lat_long_image)
+    : _face_size(std::max(1, lat_long_image.GetHeight() / 2)),
+      _texels(6 * _face_size * _face_size) {
+  for (int face = 0; face != 6; ++face) {
+    for (int y = 0; y != _face_size; ++y) {
+      for (int x = 0; x != _face_size; ++x) {
+        float s = (x + 0.5f) / _face_size * 2 - 1;
+        float t = (y + 0.5f) / _face_size * 2 - 1;
+
+        Radiance radiance = SampleLatLong(
+            lat_long_image, GetFaceDirection(face, s, t).Normalize());
+
+        _texels[(face * _face_size + y) * _face_size + x] =
+            RgbaColor(Quantize(radiance.r), Quantize(radiance.g),
+                      Quantize(radiance.b));
+      }
+    }
+  }
+}
+
+Radiance EnvironmentMap::Lookup(const Vec<3, float> &direction) const {
+  const float abs_x = std::fabs(direction[0]);
+  const float abs_y = std::fabs(direction[1]);
+  const float abs_z = std::fabs(direction[2]);
+
+  // Pick the face of the major axis and project onto it.
+  int face;
+  float major;
+  float s;
+  float t;
+  if (abs_x >= abs_y && abs_x >= abs_z) {
+    face = direction[0] > 0 ? 0 : 1;
+    major = abs_x;
+    s = direction[0] > 0 ? -direction[2] : direction[2];
+    t = -direction[1];
+  } else if (abs_y >= abs_z) {
+    face = direction[1] > 0 ? 2 : 3;
+    major = abs_y;
+    s = direction[0];
+    t = direction[1] > 0 ? direction[2] : -direction[2];
+  } else {
+    face = direction[2] > 0 ? 4 : 5;
+    major = abs_z;
+    s = direction[2] > 0 ? direction[0] : -direction[0];
+    t = -direction[1];
+  }
+
+  // Texel coordinates, clamped at the edges of the face.
+  const float scale = 0.5f * _face_size / major;
+  float x = std::clamp(s * scale + 0.5f * _face_size - 0.5f, 0.f,
+                       _face_size - 1.f);
+  float y = std::clamp(t * scale + 0.5f * _face_size - 0.5f, 0.f,
+                       _face_size - 1.f);
+
+  int x0 = static_cast<int>(x);
+  int y0 = static_cast<int>(y);
+  int x1 = std::min(x0 + 1, _face_size - 1);
+  int y1 = std::min(y0 + 1, _face_size - 1);
+  float x_ratio = x - x0;
+  float y_ratio = y - y0;
+
+  Radiance radiance00(GetTexel(face, x0, y0));
+  Radiance radiance10(GetTexel(face, x1, y0));
+  Radiance radiance01(GetTexel(face, x0, y1));
+  Radiance radiance11(GetTexel(face, x1, y1));
+
+  return (radiance00 * (1 - x_ratio) + radiance10 * x_ratio) * (1 - y_ratio) +
+         (radiance01 * (1 - x_ratio) + radiance11 * x_ratio) * y_ratio;
+}
@@ -25,19 +25,36 @@
 #include "./render.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <functional>
+#include <limits>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#include "./accumulation_buffer.h"
+#include "./environment_map.h"
 #include "./geometry/utils.h"
 #include "./light.h"
 #include "./material.h"
+#include "./radiance.h"
+#include "./ray_counters.h"
+#include "./ray_packet.h"
+#include "./sampling.h"
+#include "./scene.h"
 #include "./shape.h"
+#include "./thread_pool.h"
 
 struct CastRayOptions {
   int current_reflection;
 };
 
+// Tiles are the unit of work handed to the thread pool. They are small enough
+// that a few expensive tiles behind reflective spheres cannot stall a worker
+// while the others sit idle.
+const int kTileSize = 16;
+
 RgbaColor sky_blue(static_cast<uint8_t>(255 * 0.2),
                    static_cast<uint8_t>(255 * 0.7),
                    static_cast<uint8_t>(255 * 0.8));
@@ -49,31 +66,47 @@ RgbaColor cement_gray(static_cast<uint8_t>(255 * 0.5),
                       static_cast<uint8_t>(255 * 0.5));
 RgbaColor white(255, 255, 255);
 
-bool GetIsShadowed(const Vec<3, float> &intersection_point,
-                   const Vec<3, float> &normal,
-                   const std::vector<std::reference_wrapper<Shape>> &shapes,
-                   const Shape &target_shape, const Light &light) {
+// The ray from a surface point towards a light, started just off the surface
+// on the side of the light.
+void GetShadowRay(const Vec<3, float> &intersection_point,
+                  const Vec<3, float> &normal, const Light &light,
+                  Vec<3, float> &shadow_origin,
+                  Vec<3, float> &shadow_direction, float &max_distance) {
   Vec<3, float> light_direction =
       (intersection_point - light.GetPosition()).Normalize();
 
-  Vec<3, float> shadow_origin = light_direction * (-1) * normal >= 0
-                                    ? intersection_point + normal * kEpsilon
-                                    : intersection_point - normal * kEpsilon;
+  shadow_origin = light_direction * (-1) * normal >= 0
+                      ? intersection_point + normal * kEpsilon
+                      : intersection_point - normal * kEpsilon;
+  shadow_direction = light_direction * (-1);
+  max_distance = (light.GetPosition() - shadow_origin).length();
+}
 
-  for (const Shape &shape : shapes) {
-    if (&shape == &target_shape) {
-      continue;
-    }
+bool GetIsShadowed(const Vec<3, float> &intersection_point,
+                   const Vec<3, float> &normal, const Scene &scene,
+                   const HitRecord &target, const Light &light,
+                   OccluderCache &occluder_cache) {
+  Vec<3, float> shadow_origin;
+  Vec<3, float> shadow_direction;
+  float max_distance;
+  GetShadowRay(intersection_point, normal, light, shadow_origin,
+               shadow_direction, max_distance);
 
-    float shadow_distance = shape.GetIntersectionDistance(
-        shadow_origin, light_direction * (-1),
-        (light.GetPosition() - shadow_origin).length());
-    if (shadow_distance >= 0) {
-      return true;
-    }
-  }
+  return scene.IsOccluded(shadow_origin, shadow_direction, max_distance,
+                          target, &occluder_cache);
+}
 
-  return false;
+// The ray mirrored at a surface point, started just off the surface on the
+// side it leaves to.
+void GetReflectionRay(const Vec<3, float> &direction,
+                      const Vec<3, float> &intersection_point,
+                      const Vec<3, float> &normal,
+                      Vec<3, float> &reflect_origin,
+                      Vec<3, float> &reflect_direction) {
+  reflect_direction = Reflect(direction, normal);
+  reflect_origin = reflect_direction * normal < 0
+                       ? intersection_point - normal * kEpsilon
+                       : intersection_point + normal * kEpsilon;
 }
 
 float GetSpecularIntensity(const Vec<3, float> &intersection_point,
@@ -98,147 +131,834 @@ float GetSpecularIntensity(const Vec<3, float> &intersection_point,
   return specular_intensity_sum;
 }
 
-float GetDiffuseIntensity(
-    const Vec<3, float> &intersection_point, const Vec<3, float> &normal,
-    const Shape &target_shape,
-    const std::vector<std::reference_wrapper<Shape>> &shapes,
-    const std::vector<Light> &lights) {
+Radiance GetSpecularRadiance(const Vec<3, float> &intersection_point,
+                             const Vec<3, float> &direction,
+                             const Vec<3, float> &normal,
+                             const std::vector<Light> &lights) {
+  float specular_intensity =
+      GetSpecularIntensity(intersection_point, direction, normal, lights);
+  return Radiance(white) * std::min(specular_intensity, 1.f);
+}
+
+// Diffuse intensity from one light, as if nothing blocked it.
+float GetLightDiffuseIntensity(const Vec<3, float> &intersection_point,
+                               const Vec<3, float> &normal,
+                               const Light &light) {
+  Vec<3, float> light_direction =
+      (intersection_point - light.GetPosition()).Normalize();
+
+  return std::max(0.f, (light_direction * (-1) * normal)) *
+         light.GetIntensity();
+}
+
+float GetDiffuseIntensity(const Vec<3, float> &intersection_point,
+                          const Vec<3, float> &normal,
+                          const HitRecord &target, const Scene &scene,
+                          const std::vector<Light> &lights,
+                          std::vector<OccluderCache> &occluder_caches) {
   float diffuse_intensity_sum = 0;
 
-  for (const Light &light : lights) {
-    Vec<3, float> light_direction =
-        (intersection_point - light.GetPosition()).Normalize();
+  for (int light_index = 0; light_index != lights.size(); ++light_index) {
+    const Light &light = lights[light_index];
 
-    bool is_shadowed =
-        GetIsShadowed(intersection_point, normal, shapes, target_shape, light);
+    bool is_shadowed = GetIsShadowed(intersection_point, normal, scene, target,
+                                     light, occluder_caches[light_index]);
 
     if (is_shadowed) {
       continue;
     }
 
+    diffuse_intensity_sum +=
+        GetLightDiffuseIntensity(intersection_point, normal, light);
+  }
+
+  return diffuse_intensity_sum;
+}
+
+Radiance CastRay(const Vec<3, float> &origin, const Vec<3, float> &direction,
+                 const Scene &scene, const std::vector<Light> &lights,
+                 const EnvironmentMap &environment,
+                 std::vector<OccluderCache> &occluder_caches,
+                 const CastRayOptions options = {});
+
+// Shades the nearest hit of a ray, or the background when nothing was hit.
+Radiance ShadeHit(const Vec<3, float> &direction, const HitRecord &target,
+                  const Scene &scene, const std::vector<Light> &lights,
+                  const EnvironmentMap &environment,
+                  std::vector<OccluderCache> &occluder_caches,
+                  const CastRayOptions options) {
+  if (target.index == -1) {
+    CountRays(&RayCounters::background_lookup_count);
+    return environment.Lookup(direction);
+  }
+
+  const Vec<3, float> &intersection_point = target.point;
+  const Vec<3, float> &normal = target.normal;
+
+  const MaterialVariant &target_material =
+      scene.GetMaterial(target.material_id);
+
+  Radiance material_radiance;
+
+  if (const auto &solid_material =
+          std::get_if<SolidMaterial>(&target_material)) {
+    Radiance base_radiance(solid_material->color);
     float diffuse_intensity =
-        std::max(0.f, (light_direction * (-1) * normal)) * light.GetIntensity();
+        GetDiffuseIntensity(intersection_point, normal, target, scene, lights,
+                            occluder_caches);
+
+    material_radiance = base_radiance * std::min(diffuse_intensity, 1.f);
+  } else if (const auto *reflective_material =
+                 std::get_if<ReflectiveMaterial>(&target_material)) {
+    if (options.current_reflection >= reflective_material->max_reflection) {
+      CountRays(&RayCounters::background_lookup_count);
+      material_radiance = environment.Lookup(direction);
+    }
 
-    diffuse_intensity_sum += diffuse_intensity;
+    Vec<3, float> reflect_origin;
+    Vec<3, float> reflect_direction;
+    GetReflectionRay(direction, intersection_point, normal, reflect_origin,
+                     reflect_direction);
+    CountRays(&RayCounters::reflection_ray_count);
+    CountDepth(options.current_reflection + 1);
+
+    Radiance reflect_radiance =
+        CastRay(reflect_origin, reflect_direction, scene, lights,
+                environment, occluder_caches,
+                {options.current_reflection + 1});
+    material_radiance = reflect_radiance * 0.9f;
   }
 
-  return diffuse_intensity_sum;
+  return material_radiance +
+         GetSpecularRadiance(intersection_point, direction, normal, lights);
 }
 
-RgbaColor GetBackgroundColorFromImage(Vec<3, float> direction,
-                                      const Image<RgbaColor> &background_image,
-                                      bool is_bilinear_filtering = false) {
-  float u = std::atan2(direction[0], -direction[2]) / (kPi * 2) + 0.5f;
-  float v = 1.0f - std::acos(direction[1]) / (kPi);
+Radiance CastRay(const Vec<3, float> &origin, const Vec<3, float> &direction,
+                 const Scene &scene, const std::vector<Light> &lights,
+                 const EnvironmentMap &environment,
+                 std::vector<OccluderCache> &occluder_caches,
+                 const CastRayOptions options) {
+  HitRecord target;
+  scene.Intersect(origin, direction, std::numeric_limits<float>::max(),
+                  target);
 
-  if (is_bilinear_filtering) {
-    int width = background_image.GetWidth();
-    int height = background_image.GetHeight();
+  return ShadeHit(direction, target, scene, lights, environment,
+                  occluder_caches, options);
+}
 
-    float x = u * width;
-    float y = v * height;
+// What all primary rays of a frame share.
+struct Frame {
+  int width;
+  int height;
+  float tan_y_fov_half;
+  Vec<3, float> camera_position;
+  const Scene &scene;
+  const std::vector<Light> &lights;
+  const EnvironmentMap &environment;
+  bool use_ray_packets;
+  bool use_wavefront;
+  bool sort_reflection_rays;
+  // Nanoseconds spent per pixel, row by row, or null when not measured.
+  double *pixel_costs;
+};
 
-    int x0 = static_cast<int>(x) % width;
-    int y0 = static_cast<int>(y) % height;
-    int x1 = (x0 + 1 + width) % width;
-    int y1 = (y0 + 1 + height) % height;
+// What one thread of the pool keeps between the tiles it renders. Nothing in
+// it changes the image, so the image does not depend on which worker
+// rendered which tile.
+struct Worker {
+  // One per light.
+  std::vector<OccluderCache> occluder_caches;
 
-    float x_ratio = 1 - (x - x0);
-    float y_ratio = 1 - (y - y0);
+  RayCounters counters;
+  // Wavefront mode only, see RenderStats.
+  long long queued_divergent_packet_count = 0;
+  long long traced_divergent_packet_count = 0;
+};
 
-    RgbaColor color00 = background_image.at(x0, y0);
-    RgbaColor color01 = background_image.at(x0, y1);
-    RgbaColor color10 = background_image.at(x1, y0);
-    RgbaColor color11 = background_image.at(x1, y1);
+// Primary samples collected over a tile and traced together, so that packets
+// are filled across pixel boundaries. Positions are on the image plane in
+// pixels. The samples of a pixel are stored, and accumulated, in sample order.
+struct SampleBatch {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<int> pixel_i;
+  std::vector<int> pixel_j;
 
-    RgbaColor color0 = GetAverageColor(color00, color01, y_ratio);
-    RgbaColor color1 = GetAverageColor(color10, color11, y_ratio);
+  int size() const { return x.size(); }
 
-    return GetAverageColor(color0, color1, x_ratio);
+  void Add(int i, int j, float sample_x, float sample_y) {
+    x.push_back(sample_x);
+    y.push_back(sample_y);
+    pixel_i.push_back(i);
+    pixel_j.push_back(j);
   }
+};
 
-  int x = static_cast<int>(u * (background_image.GetWidth() - 1));
-  int y = static_cast<int>(v * (background_image.GetHeight() - 1));
+// Adds sample_count samples of pixel (i, j), starting at sample index
+// first_sample. The samples are stratified over the pixel among themselves,
+// so that every batch covers it evenly, except that a lone first sample goes
+// through the pixel center. A lone later sample is jittered over the whole
+// pixel rather than repeating the center.
+void AddPixelSamples(int i, int j, int first_sample, int sample_count,
+                     SampleBatch &batch) {
+  if (first_sample == 0 && sample_count == 1) {
+    batch.Add(i, j, i + 0.5f, j + 0.5f);
+    return;
+  }
 
-  return background_image.at(x, y);
+  for (int stratum = 0; stratum != sample_count; ++stratum) {
+    float x;
+    float y;
+    GetStratifiedSample(i, j, first_sample + stratum, stratum, sample_count, x,
+                        y);
+    batch.Add(i, j, i + x, j + y);
+  }
 }
 
-RgbaColor CastRay(const Vec<3, float> &origin, const Vec<3, float> &direction,
-                  const std::vector<std::reference_wrapper<Shape>> &shapes,
-                  const std::vector<Light> &lights,
-                  const Image<RgbaColor> &background_image,
-                  const CastRayOptions options = {}) {
-  float ray_length = std::numeric_limits<float>::max();
+Vec<3, float> GetPrimaryRayDirection(const Frame &frame, float x, float y) {
+  float ray_x = (2 * x / static_cast<float>(frame.width) - 1) *
+                frame.tan_y_fov_half * frame.width / frame.height;
+  float ray_y =
+      (2 * y / static_cast<float>(frame.height) - 1) * frame.tan_y_fov_half;
 
-  int target_shape_index = -1;
-  float nearest_distance = std::numeric_limits<float>::max();
+  return Vec<3, float>({ray_x, ray_y, -1.f}).Normalize();
+}
+
+// Traces the primary ray through image plane position (x, y). shape_id
+// receives the shape it hit, or -1.
+Radiance CastPrimaryRay(const Frame &frame, float x, float y,
+                        std::vector<OccluderCache> &occluder_caches,
+                        int &shape_id) {
+  Vec<3, float> direction = GetPrimaryRayDirection(frame, x, y);
+
+  HitRecord target;
+  frame.scene.Intersect(frame.camera_position, direction,
+                        std::numeric_limits<float>::max(), target);
+  shape_id = target.index == -1 ? -1 : target.shape_id;
+
+  return ShadeHit(direction, target, frame.scene, frame.lights,
+                  frame.environment, occluder_caches, {});
+}
+
+// CastPrimaryRay() for lane_count positions as one packet. The nearest hits
+// are found for all lanes at once; shading, shadows and reflections diverge
+// from there and continue ray by ray.
+void CastPrimaryRayPacket(const Frame &frame, const float *sample_x,
+                          const float *sample_y, int lane_count,
+                          std::vector<OccluderCache> &occluder_caches,
+                          Radiance *radiances, int *shape_ids) {
+  // Unused lanes repeat the first one, so that they hold valid rays.
+  float lane_x[kPacketSize];
+  float lane_y[kPacketSize];
+  for (int lane = 0; lane != kPacketSize; ++lane) {
+    lane_x[lane] = sample_x[lane < lane_count ? lane : 0];
+    lane_y[lane] = sample_y[lane < lane_count ? lane : 0];
+  }
+
+  // Same operations as GetPrimaryRayDirection(), lane by lane.
+  const PacketFloat width(static_cast<float>(frame.width));
+  const PacketFloat height(static_cast<float>(frame.height));
+  const PacketFloat tan_y_fov_half(frame.tan_y_fov_half);
 
-  for (int i = 0; i != shapes.size(); ++i) {
-    const auto &shape = shapes[i].get();
+  PacketFloat x = (PacketFloat(2.f) * PacketFloat::Load(lane_x) / width -
+                   PacketFloat(1.f)) *
+                  tan_y_fov_half * width / height;
+  PacketFloat y = (PacketFloat(2.f) * PacketFloat::Load(lane_y) / height -
+                   PacketFloat(1.f)) *
+                  tan_y_fov_half;
+  PacketFloat z(-1.f);
+  PacketFloat length = Sqrt(x * x + y * y + z * z);
 
-    float current_distance =
-        shape.GetIntersectionDistance(origin, direction, ray_length);
-    if (current_distance >= 0 && current_distance < nearest_distance) {
-      target_shape_index = i;
-      nearest_distance = current_distance;
+  RayPacket packet;
+  packet.direction[0] = x / length;
+  packet.direction[1] = y / length;
+  packet.direction[2] = z / length;
+  for (int axis = 0; axis != 3; ++axis) {
+    packet.origin[axis] = PacketFloat(frame.camera_position[axis]);
+    packet.inverse_direction[axis] = PacketFloat(1.f) / packet.direction[axis];
+  }
+  packet.active = PacketMask::FromBits((1 << lane_count) - 1);
+
+  HitRecord targets[kPacketSize];
+  frame.scene.IntersectPacket(
+      packet, PacketFloat(std::numeric_limits<float>::max()), targets);
+
+  float directions[3][kPacketSize];
+  for (int axis = 0; axis != 3; ++axis) {
+    packet.direction[axis].Store(directions[axis]);
+  }
+
+  for (int lane = 0; lane != lane_count; ++lane) {
+    Vec<3, float> direction(
+        {directions[0][lane], directions[1][lane], directions[2][lane]});
+
+    shape_ids[lane] = targets[lane].index == -1 ? -1 : targets[lane].shape_id;
+    radiances[lane] =
+        ShadeHit(direction, targets[lane], frame.scene, frame.lights,
+                 frame.environment, occluder_caches, {});
+  }
+}
+
+// Rays of one wavefront stage as structure of arrays. path is the sample of
+// the batch that a ray contributes to.
+struct RayQueue {
+  std::vector<int> path;
+  std::vector<float> origin[3];
+  std::vector<float> direction[3];
+
+  int size() const { return path.size(); }
+
+  void Add(int path_index, const Vec<3, float> &ray_origin,
+           const Vec<3, float> &ray_direction) {
+    path.push_back(path_index);
+    for (int axis = 0; axis != 3; ++axis) {
+      origin[axis].push_back(ray_origin[axis]);
+      direction[axis].push_back(ray_direction[axis]);
     }
   }
 
-  if (target_shape_index == -1) {
-    return GetBackgroundColorFromImage(direction, background_image);
+  Vec<3, float> GetOrigin(int k) const {
+    return Vec<3, float>({origin[0][k], origin[1][k], origin[2][k]});
   }
+  Vec<3, float> GetDirection(int k) const {
+    return Vec<3, float>({direction[0][k], direction[1][k], direction[2][k]});
+  }
+};
 
-  const auto &target_shape = shapes[target_shape_index].get();
+// Finds the nearest hit of every ray of a queue, kPacketSize rays at a time
+// when packets are enabled.
+void IntersectQueue(const Frame &frame, const RayQueue &rays,
+                    std::vector<HitRecord> &hits) {
+  hits.resize(rays.size());
 
-  Vec<3, float> intersection_point = origin + direction * nearest_distance;
-  Vec<3, float> normal = target_shape.GetNormal(intersection_point);
+  if (!frame.use_ray_packets) {
+    for (int k = 0; k != rays.size(); ++k) {
+      frame.scene.Intersect(rays.GetOrigin(k), rays.GetDirection(k),
+                            std::numeric_limits<float>::max(), hits[k]);
+    }
+    return;
+  }
 
-  MaterialVariant target_material = target_shape.GetMaterial();
+  for (int first = 0; first < rays.size(); first += kPacketSize) {
+    const int count = std::min(kPacketSize, rays.size() - first);
 
-  RgbaColor base_color;
-  bool has_diffuse = false;
-  bool has_specular = false;
+    // Unused lanes repeat the first one, so that they hold valid rays.
+    RayPacket packet;
+    for (int axis = 0; axis != 3; ++axis) {
+      float origins[kPacketSize];
+      float directions[kPacketSize];
+      for (int lane = 0; lane != kPacketSize; ++lane) {
+        const int k = first + (lane < count ? lane : 0);
+        origins[lane] = rays.origin[axis][k];
+        directions[lane] = rays.direction[axis][k];
+      }
+      packet.origin[axis] = PacketFloat::Load(origins);
+      packet.direction[axis] = PacketFloat::Load(directions);
+      packet.inverse_direction[axis] = PacketFloat(1.f) / packet.direction[axis];
+    }
+    packet.active = PacketMask::FromBits((1 << count) - 1);
 
-  RgbaColor material_color;
+    HitRecord packet_hits[kPacketSize];
+    frame.scene.IntersectPacket(
+        packet, PacketFloat(std::numeric_limits<float>::max()), packet_hits);
+    std::copy(packet_hits, packet_hits + count, hits.begin() + first);
+  }
+}
 
-  if (const auto &solid_material =
-          std::get_if<SolidMaterial>(&target_material)) {
-    RgbaColor base_color = solid_material->color;
-    float diffuse_intensity = GetDiffuseIntensity(intersection_point, normal,
-                                                  target_shape, shapes, lights);
+// Whether the light is blocked from each of the hits selected by hit_indices.
+// All shadow rays go towards the same light, so neighbouring ones stay close
+// together and are traced kPacketSize at a time when packets are enabled.
+std::vector<uint8_t> TraceShadowRays(const Frame &frame,
+                                     const std::vector<HitRecord> &hits,
+                                     const std::vector<int> &hit_indices,
+                                     const Light &light,
+                                     OccluderCache &occluder_cache) {
+  std::vector<uint8_t> is_shadowed(hit_indices.size());
+  const int step = frame.use_ray_packets ? kPacketSize : 1;
 
-    material_color = base_color * std::min(diffuse_intensity, 1.f);
-  } else if (const auto *reflective_material =
-                 std::get_if<ReflectiveMaterial>(&target_material)) {
-    if (options.current_reflection >= reflective_material->max_reflection) {
-      material_color = GetBackgroundColorFromImage(direction, background_image);
+  for (int first = 0; first < hit_indices.size(); first += step) {
+    const int count = std::min<int>(step, hit_indices.size() - first);
+
+    float origins[3][kPacketSize];
+    float directions[3][kPacketSize];
+    float max_distances[kPacketSize];
+    HitRecord ignored[kPacketSize];
+    for (int lane = 0; lane != count; ++lane) {
+      const HitRecord &hit = hits[hit_indices[first + lane]];
+
+      Vec<3, float> shadow_origin;
+      Vec<3, float> shadow_direction;
+      GetShadowRay(hit.point, hit.normal, light, shadow_origin,
+                   shadow_direction, max_distances[lane]);
+      for (int axis = 0; axis != 3; ++axis) {
+        origins[axis][lane] = shadow_origin[axis];
+        directions[axis][lane] = shadow_direction[axis];
+      }
+      ignored[lane] = hit;
+    }
+
+    if (step == 1) {
+      is_shadowed[first] = frame.scene.IsOccluded(
+          Vec<3, float>({origins[0][0], origins[1][0], origins[2][0]}),
+          Vec<3, float>({directions[0][0], directions[1][0], directions[2][0]}),
+          max_distances[0], ignored[0], &occluder_cache);
+      continue;
+    }
+
+    // Unused lanes repeat the first one, so that they hold valid rays.
+    for (int lane = count; lane != kPacketSize; ++lane) {
+      for (int axis = 0; axis != 3; ++axis) {
+        origins[axis][lane] = origins[axis][0];
+        directions[axis][lane] = directions[axis][0];
+      }
+      max_distances[lane] = max_distances[0];
+      ignored[lane] = ignored[0];
     }
 
-    Vec<3, float> reflect_direction = Reflect(direction, normal);
-    Vec<3, float> reflect_origin = reflect_direction * normal < 0
-                                       ? intersection_point - normal * kEpsilon
-                                       : intersection_point + normal * kEpsilon;
+    RayPacket packet;
+    for (int axis = 0; axis != 3; ++axis) {
+      packet.origin[axis] = PacketFloat::Load(origins[axis]);
+      packet.direction[axis] = PacketFloat::Load(directions[axis]);
+      packet.inverse_direction[axis] = PacketFloat(1.f) / packet.direction[axis];
+    }
+    packet.active = PacketMask::FromBits((1 << count) - 1);
 
-    RgbaColor reflect_color =
-        CastRay(reflect_origin, reflect_direction, shapes, lights,
-                background_image, {options.current_reflection + 1});
-    material_color = reflect_color * 0.9;
+    const int occluded_bits =
+        frame.scene
+            .IsOccludedPacket(packet, PacketFloat::Load(max_distances),
+                              ignored, &occluder_cache)
+            .GetBits();
+    for (int lane = 0; lane != count; ++lane) {
+      is_shadowed[first + lane] = (occluded_bits >> lane) & 1;
+    }
   }
 
-  float specular_intensity =
-      GetSpecularIntensity(intersection_point, direction, normal, lights);
-  RgbaColor specular_color = white * std::min(specular_intensity, 1.f);
+  return is_shadowed;
+}
 
-  return material_color + specular_color;
+// Spreads the lowest 4 bits of value out to every third bit.
+uint32_t SpreadBits(uint32_t value) {
+  value &= 0xf;
+  value = (value | (value << 4)) & 0x0c3;
+  value = (value | (value << 2)) & 0x249;
+  return value;
 }
 
-Image<RgbaColor> Render(int width, int height, float y_fov,
-                        const Vec<3, float> camera_position,
-                        const Image<RgbaColor> &background_image) {
-  Image<RgbaColor> image(width, height);
+// Which of the eight octants a direction points into, one bit per axis.
+int GetOctant(const RayQueue &rays, int k) {
+  return (rays.direction[0][k] < 0) | (rays.direction[1][k] < 0) << 1 |
+         (rays.direction[2][k] < 0) << 2;
+}
+
+// Reorders a queue by direction octant first and by the Morton code of the
+// origin on a 16 x 16 x 16 grid over the bounds of all origins second, so
+// that rays traced together leave from nearby points in similar directions
+// and walk the same BVH nodes. The 15 bit keys are sorted by two stable
+// counting passes, which keep ties in their order and cost linear time.
+void SortRays(RayQueue &rays) {
+  const int ray_count = rays.size();
+  if (ray_count < 2) {
+    return;
+  }
+
+  Aabb bounds;
+  for (int k = 0; k != ray_count; ++k) {
+    bounds.Extend(rays.GetOrigin(k));
+  }
+
+  std::vector<uint16_t> keys(ray_count);
+  for (int k = 0; k != ray_count; ++k) {
+    uint32_t morton_code = 0;
+    for (int axis = 0; axis != 3; ++axis) {
+      const float extent = bounds.max[axis] - bounds.min[axis];
+      const float position =
+          extent > 0 ? (rays.origin[axis][k] - bounds.min[axis]) / extent : 0;
+      morton_code |= SpreadBits(static_cast<uint32_t>(position * 15.f))
+                     << axis;
+    }
+    keys[k] = GetOctant(rays, k) << 12 | morton_code;
+  }
+
+  std::vector<int> order(ray_count);
+  std::vector<int> sorted_order(ray_count);
+  for (int k = 0; k != ray_count; ++k) {
+    order[k] = k;
+  }
+  for (int shift = 0; shift != 16; shift += 8) {
+    int offsets[257] = {};
+    for (int k : order) {
+      ++offsets[((keys[k] >> shift) & 0xff) + 1];
+    }
+    for (int digit = 0; digit != 256; ++digit) {
+      offsets[digit + 1] += offsets[digit];
+    }
+    for (int k : order) {
+      sorted_order[offsets[(keys[k] >> shift) & 0xff]++] = k;
+    }
+    order.swap(sorted_order);
+  }
+
+  RayQueue sorted;
+  sorted.path.resize(ray_count);
+  for (int k = 0; k != ray_count; ++k) {
+    sorted.path[k] = rays.path[order[k]];
+  }
+  for (int axis = 0; axis != 3; ++axis) {
+    sorted.origin[axis].resize(ray_count);
+    sorted.direction[axis].resize(ray_count);
+    for (int k = 0; k != ray_count; ++k) {
+      sorted.origin[axis][k] = rays.origin[axis][order[k]];
+      sorted.direction[axis][k] = rays.direction[axis][order[k]];
+    }
+  }
+  rays = std::move(sorted);
+}
+
+// Number of packets of kPacketSize consecutive rays whose directions do not
+// all share one octant.
+long long CountDivergentPackets(const RayQueue &rays) {
+  long long count = 0;
+  for (int first = 0; first < rays.size(); first += kPacketSize) {
+    const int end = std::min(first + kPacketSize, rays.size());
+    for (int k = first + 1; k < end; ++k) {
+      if (GetOctant(rays, k) != GetOctant(rays, first)) {
+        ++count;
+        break;
+      }
+    }
+  }
+  return count;
+}
+
+// A reflective hit waiting for the radiance of its reflection ray.
+struct PendingReflection {
+  int path;
+  Radiance specular_radiance;
+};
+
+// Traces a batch stage by stage instead of ray by ray. Every stage runs one
+// kind of work over all paths that are still alive: nearest hits for a queue
+// of rays, then the shadow rays of all solid hits light by light, then the
+// reflection rays that make up the next queue. Paths end at a solid hit or in
+// the background. Reflections are resolved from the last bounce back to the
+// first with the same operations as ShadeHit(), so the radiances equal those
+// of CastPrimaryRay().
+void TraceSampleBatchWavefront(const Frame &frame, const SampleBatch &batch,
+                               Worker &worker, AccumulationBuffer &buffer) {
+  std::vector<Radiance> radiances(batch.size());
+  std::vector<int> shape_ids(batch.size());
+
+  RayQueue rays;
+  for (int k = 0; k != batch.size(); ++k) {
+    rays.Add(k, frame.camera_position,
+             GetPrimaryRayDirection(frame, batch.x[k], batch.y[k]));
+  }
+
+  std::vector<HitRecord> hits;
+  std::vector<std::vector<PendingReflection>> bounces;
+
+  for (bool is_primary = true; rays.size() > 0; is_primary = false) {
+    IntersectQueue(frame, rays, hits);
 
-  std::vector<std::reference_wrapper<Shape>> shapes;
+    RayQueue reflection_rays;
+    std::vector<PendingReflection> reflections;
+    // Rays of this stage that hit a SolidMaterial.
+    std::vector<int> solid_rays;
 
+    for (int k = 0; k != rays.size(); ++k) {
+      const int path = rays.path[k];
+      const HitRecord &hit = hits[k];
+      if (is_primary) {
+        shape_ids[path] = hit.index == -1 ? -1 : hit.shape_id;
+      }
+
+      if (hit.index == -1) {
+        CountRays(&RayCounters::background_lookup_count);
+        radiances[path] = frame.environment.Lookup(rays.GetDirection(k));
+        continue;
+      }
+
+      if (std::holds_alternative<SolidMaterial>(
+              frame.scene.GetMaterial(hit.material_id))) {
+        solid_rays.push_back(k);
+        continue;
+      }
+
+      Vec<3, float> reflect_origin;
+      Vec<3, float> reflect_direction;
+      GetReflectionRay(rays.GetDirection(k), hit.point, hit.normal,
+                       reflect_origin, reflect_direction);
+      reflection_rays.Add(path, reflect_origin, reflect_direction);
+      reflections.push_back(
+          {path, GetSpecularRadiance(hit.point, rays.GetDirection(k),
+                                     hit.normal, frame.lights)});
+    }
+
+    std::vector<float> diffuse_intensities(solid_rays.size(), 0.f);
+    for (int light_index = 0; light_index != frame.lights.size();
+         ++light_index) {
+      const std::vector<uint8_t> is_shadowed = TraceShadowRays(
+          frame, hits, solid_rays, frame.lights[light_index],
+          worker.occluder_caches[light_index]);
+
+      for (int s = 0; s != solid_rays.size(); ++s) {
+        const HitRecord &hit = hits[solid_rays[s]];
+        if (!is_shadowed[s]) {
+          diffuse_intensities[s] += GetLightDiffuseIntensity(
+              hit.point, hit.normal, frame.lights[light_index]);
+        }
+      }
+    }
+
+    for (int s = 0; s != solid_rays.size(); ++s) {
+      const int k = solid_rays[s];
+      const HitRecord &hit = hits[k];
+      const auto &solid_material =
+          std::get<SolidMaterial>(frame.scene.GetMaterial(hit.material_id));
+
+      radiances[rays.path[k]] =
+          Radiance(solid_material.color) *
+              std::min(diffuse_intensities[s], 1.f) +
+          GetSpecularRadiance(hit.point, rays.GetDirection(k), hit.normal,
+                              frame.lights);
+    }
+
+    bounces.push_back(std::move(reflections));
+    rays = std::move(reflection_rays);
+
+    CountRays(&RayCounters::reflection_ray_count, rays.size());
+    if (rays.size() > 0) {
+      CountDepth(bounces.size());
+    }
+
+    worker.queued_divergent_packet_count += CountDivergentPackets(rays);
+    if (frame.sort_reflection_rays) {
+      SortRays(rays);
+    }
+    worker.traced_divergent_packet_count += CountDivergentPackets(rays);
+  }
+
+  for (auto bounce = bounces.rbegin(); bounce != bounces.rend(); ++bounce) {
+    for (const PendingReflection &reflection : *bounce) {
+      radiances[reflection.path] =
+          radiances[reflection.path] * 0.9f + reflection.specular_radiance;
+    }
+  }
+
+  for (int k = 0; k != batch.size(); ++k) {
+    buffer.Add(batch.pixel_i[k], batch.pixel_j[k], radiances[k], shape_ids[k]);
+  }
+}
+
+void TraceSampleBatchRayByRay(const Frame &frame, const SampleBatch &batch,
+                              Worker &worker, AccumulationBuffer &buffer) {
+  std::vector<OccluderCache> &occluder_caches = worker.occluder_caches;
+
+  for (int first = 0; first < batch.size(); first += kPacketSize) {
+    const int count = std::min(kPacketSize, batch.size() - first);
+
+    Radiance radiances[kPacketSize];
+    int shape_ids[kPacketSize];
+    if (frame.use_ray_packets) {
+      CastPrimaryRayPacket(frame, &batch.x[first], &batch.y[first], count,
+                           occluder_caches, radiances, shape_ids);
+    } else {
+      for (int k = 0; k != count; ++k) {
+        radiances[k] = CastPrimaryRay(frame, batch.x[first + k],
+                                      batch.y[first + k], occluder_caches,
+                                      shape_ids[k]);
+      }
+    }
+
+    for (int k = 0; k != count; ++k) {
+      buffer.Add(batch.pixel_i[first + k], batch.pixel_j[first + k],
+                 radiances[k], shape_ids[k]);
+    }
+  }
+}
+
+// Traces every sample on its own and adds the time it took, shadow rays and
+// reflections included, to its pixel in frame.pixel_costs.
+void TraceSampleBatchTimed(const Frame &frame, const SampleBatch &batch,
+                           Worker &worker, AccumulationBuffer &buffer) {
+  for (int k = 0; k != batch.size(); ++k) {
+    const auto start = std::chrono::steady_clock::now();
+
+    int shape_id;
+    Radiance radiance = CastPrimaryRay(frame, batch.x[k], batch.y[k],
+                                       worker.occluder_caches, shape_id);
+
+    const auto end = std::chrono::steady_clock::now();
+    frame.pixel_costs[batch.pixel_j[k] * frame.width + batch.pixel_i[k]] +=
+        std::chrono::duration<double, std::nano>(end - start).count();
+
+    buffer.Add(batch.pixel_i[k], batch.pixel_j[k], radiance, shape_id);
+  }
+}
+
+void TraceSampleBatch(const Frame &frame, const SampleBatch &batch,
+                      Worker &worker, AccumulationBuffer &buffer) {
+  // Whatever the scene and the shading count on this thread goes to the
+  // worker until the batch is done.
+  if constexpr (kCountRays) {
+    thread_ray_counters = &worker.counters;
+  }
+
+  if (frame.pixel_costs != nullptr) {
+    TraceSampleBatchTimed(frame, batch, worker, buffer);
+  } else if (frame.use_wavefront) {
+    TraceSampleBatchWavefront(frame, batch, worker, buffer);
+  } else {
+    TraceSampleBatchRayByRay(frame, batch, worker, buffer);
+  }
+
+  if constexpr (kCountRays) {
+    thread_ray_counters = nullptr;
+  }
+}
+
+// Takes the first sample_count samples of the pixels of a tile whose
+// coordinates are both multiples of step. With skip_coarser, the pixels whose
+// coordinates are also multiples of 2 * step were sampled by the previous
+// pass and are left out. Tile corners are multiples of kTileSize, which step
+// has to divide.
+void RenderTilePass(const Frame &frame, int min_i, int min_j, int max_i,
+                    int max_j, int step, bool skip_coarser, int sample_count,
+                    Worker &worker, AccumulationBuffer &buffer) {
+  SampleBatch batch;
+
+  for (int j = min_j; j < max_j; j += step) {
+    int first_i = min_i;
+    int stride = step;
+    if (skip_coarser && j % (2 * step) == 0) {
+      first_i += step;
+      stride *= 2;
+    }
+
+    for (int i = first_i; i < max_i; i += stride) {
+      AddPixelSamples(i, j, 0, sample_count, batch);
+    }
+  }
+
+  TraceSampleBatch(frame, batch, worker, buffer);
+}
+
+// Takes the samples first_sample to first_sample + sample_count - 1 of the
+// marked pixels of a tile.
+void RefineTile(const Frame &frame, int min_i, int min_j, int max_i,
+                int max_j, const std::vector<uint8_t> &is_refined,
+                int first_sample, int sample_count, Worker &worker,
+                AccumulationBuffer &buffer) {
+  SampleBatch batch;
+
+  for (int j = min_j; j != max_j; ++j) {
+    for (int i = min_i; i != max_i; ++i) {
+      if (is_refined[j * frame.width + i]) {
+        AddPixelSamples(i, j, first_sample, sample_count, batch);
+      }
+    }
+  }
+
+  TraceSampleBatch(frame, batch, worker, buffer);
+}
+
+// Marks the pixels that get more samples: those whose primary rays hit
+// different shapes and those whose luminance variance exceeds the threshold.
+// When the ray budget cannot cover all of them, mixed pixels come first, then
+// the highest variances, with ties going to the lower pixel index. The choice
+// only depends on the samples taken so far, so it is the same for any thread
+// count.
+std::vector<uint8_t> SelectPixelsToRefine(const AccumulationBuffer &buffer,
+                                          const RenderOptions &options) {
+  const int width = buffer.GetWidth();
+  const int height = buffer.GetHeight();
+
+  std::vector<std::pair<float, int>> candidates;
+  for (int j = 0; j != height; ++j) {
+    for (int i = 0; i != width; ++i) {
+      if (buffer.HasMixedShapes(i, j)) {
+        candidates.push_back(
+            {std::numeric_limits<float>::infinity(), j * width + i});
+        continue;
+      }
+
+      float variance = buffer.GetLuminanceVariance(i, j);
+      if (variance > options.variance_threshold) {
+        candidates.push_back({variance, j * width + i});
+      }
+    }
+  }
+
+  if (options.max_primary_ray_count > 0) {
+    const long long extra_sample_count =
+        options.max_sample_count - options.initial_sample_count;
+    const long long remaining_ray_count =
+        options.max_primary_ray_count -
+        static_cast<long long>(width) * height * options.initial_sample_count;
+    const long long affordable_count =
+        std::max(0ll, remaining_ray_count / extra_sample_count);
+
+    if (candidates.size() > affordable_count) {
+      std::sort(candidates.begin(), candidates.end(),
+                [](const std::pair<float, int> &a,
+                   const std::pair<float, int> &b) {
+                  return a.first != b.first ? a.first > b.first
+                                            : a.second < b.second;
+                });
+      candidates.resize(affordable_count);
+    }
+  }
+
+  std::vector<uint8_t> is_refined(width * height);
+  for (const auto &candidate : candidates) {
+    is_refined[candidate.second] = 1;
+  }
+  return is_refined;
+}
+
+// Tone maps every pixel that has samples and fills the others with the
+// top-left pixel of their step x step block, which always has some.
+void ResolvePreview(const AccumulationBuffer &buffer, int step,
+                    Image<RgbaColor> &image) {
+  buffer.Resolve(image);
+
+  if (step == 1) {
+    return;
+  }
+
+  for (int j = 0; j != buffer.GetHeight(); ++j) {
+    for (int i = 0; i != buffer.GetWidth(); ++i) {
+      if (buffer.GetSampleCount(i, j) == 0) {
+        image.set(i, j, image.at(i - i % step, j - j % step));
+      }
+    }
+  }
+}
+
+// Maps pixel costs to gray levels, the most expensive pixels white. The scale
+// ends at the 99.9th percentile rather than at the maximum, so that a few
+// samples the thread lost its core during do not leave the rest black.
+Image<GrayscaleColor> GetCostImage(const std::vector<double> &pixel_costs,
+                                   int width, int height) {
+  std::vector<double> sorted_costs = pixel_costs;
+  auto percentile =
+      sorted_costs.begin() + (sorted_costs.size() - 1) * 999 / 1000;
+  std::nth_element(sorted_costs.begin(), percentile, sorted_costs.end());
+  const double max_cost = *percentile;
+
+  Image<GrayscaleColor> image(width, height);
+  for (int j = 0; j != height; ++j) {
+    for (int i = 0; i != width; ++i) {
+      const double cost = pixel_costs[j * width + i];
+      const double level =
+          max_cost > 0 ? std::min(cost / max_cost, 1.) * 255 + 0.5 : 0;
+      image.set(i, j, GrayscaleColor(static_cast<uint8_t>(level)));
+    }
+  }
+  return image;
+}
+
+Scene CreateDefaultScene() {
   Sphere sphere1 =
       Sphere(SolidMaterial(cement_gray), 0.5f, Vec<3, float>({-1, 0, -3.5}));
   Sphere sphere2 =
@@ -251,12 +971,37 @@ Image<RgbaColor> Render(int width, int height, float y_fov,
   Plane plane = Plane(SolidMaterial(white), Vec<3, float>({0, 1, 0}),
                       Vec<3, float>({0, -1.25, -3}), 5, 5);
 
-  shapes.push_back(sphere1);
-  shapes.push_back(sphere2);
-  shapes.push_back(sphere3);
-  shapes.push_back(sphere4);
+  Scene scene;
+
+  scene.Add(sphere1);
+  scene.Add(sphere2);
+  scene.Add(sphere3);
+  scene.Add(sphere4);
+
+  scene.Add(plane);
+
+  scene.Build();
 
-  shapes.push_back(plane);
+  return scene;
+}
+
+// Renders the image in passes, one per entry of steps. A pass samples the
+// pixels whose coordinates are multiples of its step and that no earlier pass
+// has sampled, so with a final step of 1 every pixel gets its initial samples
+// exactly once. With adaptive sampling, a last pass adds samples where those
+// disagree. on_pass, when set, receives the image after every pass.
+Image<RgbaColor> RenderPasses(
+    int width, int height, float y_fov, const Vec<3, float> camera_position,
+    const EnvironmentMap &environment, const RenderOptions &options,
+    const std::vector<int> &steps,
+    const std::function<void(const Image<RgbaColor> &)> &on_pass) {
+  Image<RgbaColor> image(width, height);
+  AccumulationBuffer buffer(width, height);
+
+  const Scene default_scene =
+      options.scene == nullptr ? CreateDefaultScene() : Scene();
+  const Scene &scene =
+      options.scene == nullptr ? default_scene : *options.scene;
 
   std::vector<Light> lights;
 
@@ -265,20 +1010,129 @@ Image<RgbaColor> Render(int width, int height, float y_fov,
 
   float tan_y_fov_half = std::tan((y_fov * kPi / 180) / 2);
 
-  for (int j = 0; j != height; ++j) {
-    for (int i = 0; i != width; ++i) {
-      float x = (2 * (i + 0.5f) / static_cast<float>(width) - 1) *
-                tan_y_fov_half * width / height;
-      float y =
-          (2 * (j + 0.5f) / static_cast<float>(height) - 1) * tan_y_fov_half;
+  std::vector<double> pixel_costs;
+  if (options.cost_image != nullptr) {
+    pixel_costs.resize(width * height);
+  }
+
+  const Frame frame = {width,
+                       height,
+                       tan_y_fov_half,
+                       camera_position,
+                       scene,
+                       lights,
+                       environment,
+                       options.use_ray_packets,
+                       options.use_wavefront,
+                       options.sort_reflection_rays,
+                       options.cost_image != nullptr ? pixel_costs.data()
+                                                     : nullptr};
+
+  const int tile_columns = (width + kTileSize - 1) / kTileSize;
+  const int tile_rows = (height + kTileSize - 1) / kTileSize;
+
+  ThreadPool thread_pool(options.thread_count > 0 ? options.thread_count
+                                                  : GetDefaultThreadCount());
+
+  std::vector<Worker> workers(thread_pool.GetThreadCount());
+  for (Worker &worker : workers) {
+    worker.occluder_caches.resize(lights.size());
+  }
+
+  for (int pass = 0; pass != steps.size(); ++pass) {
+    const int step = steps[pass];
+    const bool skip_coarser = pass > 0 && steps[pass - 1] == 2 * step;
+
+    // Every pixel is computed independently and written by one task only, so
+    // the result does not depend on the thread count or on the tile order.
+    thread_pool.ParallelFor(
+        tile_columns * tile_rows, [&](int tile_index, int worker_index) {
+          int min_i = (tile_index % tile_columns) * kTileSize;
+          int min_j = (tile_index / tile_columns) * kTileSize;
+          int max_i = std::min(min_i + kTileSize, width);
+          int max_j = std::min(min_j + kTileSize, height);
+
+          RenderTilePass(frame, min_i, min_j, max_i, max_j, step,
+                         skip_coarser, options.initial_sample_count,
+                         workers[worker_index], buffer);
+        });
+
+    if (on_pass) {
+      ResolvePreview(buffer, step, image);
+      on_pass(image);
+    }
+  }
 
-      Vec<3, float> ray_direction = Vec<3, float>({x, y, -1.f}).Normalize();
+  long long refined_pixel_count = 0;
+  if (options.max_sample_count > options.initial_sample_count) {
+    const std::vector<uint8_t> is_refined =
+        SelectPixelsToRefine(buffer, options);
+    refined_pixel_count =
+        std::count(is_refined.begin(), is_refined.end(), uint8_t(1));
 
-      image.set(i, j,
-                CastRay(camera_position, ray_direction, shapes, lights,
-                        background_image));
+    thread_pool.ParallelFor(
+        tile_columns * tile_rows, [&](int tile_index, int worker_index) {
+          int min_i = (tile_index % tile_columns) * kTileSize;
+          int min_j = (tile_index / tile_columns) * kTileSize;
+          int max_i = std::min(min_i + kTileSize, width);
+          int max_j = std::min(min_j + kTileSize, height);
+
+          RefineTile(frame, min_i, min_j, max_i, max_j, is_refined,
+                     options.initial_sample_count,
+                     options.max_sample_count - options.initial_sample_count,
+                     workers[worker_index], buffer);
+        });
+
+    if (on_pass) {
+      ResolvePreview(buffer, 1, image);
+      on_pass(image);
+    }
+  }
+
+  if (!on_pass) {
+    ResolvePreview(buffer, 1, image);
+  }
+
+  if (options.cost_image != nullptr) {
+    *options.cost_image = GetCostImage(pixel_costs, width, height);
+  }
+
+  if (options.stats != nullptr) {
+    *options.stats = RenderStats();
+    options.stats->primary_ray_count =
+        static_cast<long long>(width) * height * options.initial_sample_count +
+        refined_pixel_count *
+            (options.max_sample_count - options.initial_sample_count);
+    options.stats->refined_pixel_count = refined_pixel_count;
+    for (const Worker &worker : workers) {
+      for (const OccluderCache &occluder_cache : worker.occluder_caches) {
+        options.stats->shadow_ray_count += occluder_cache.query_count;
+        options.stats->shadow_cache_hit_count += occluder_cache.hit_count;
+      }
+      options.stats->counters.Merge(worker.counters);
+      options.stats->queued_divergent_packet_count +=
+          worker.queued_divergent_packet_count;
+      options.stats->traced_divergent_packet_count +=
+          worker.traced_divergent_packet_count;
     }
   }
 
   return image;
 }
+
+Image<RgbaColor> Render(int width, int height, float y_fov,
+                        const Vec<3, float> camera_position,
+                        const EnvironmentMap &environment,
+                        const RenderOptions &options) {
+  return RenderPasses(width, height, y_fov, camera_position, environment,
+                      options, {1}, {});
+}
+
+Image<RgbaColor> RenderProgressive(
+    int width, int height, float y_fov, const Vec<3, float> camera_position,
+    const EnvironmentMap &environment,
+    const std::function<void(const Image<RgbaColor> &)> &on_pass,
+    const RenderOptions &options) {
+  return RenderPasses(width, height, y_fov, camera_position, environment,
+                      options, {8, 4, 2, 1}, on_pass);
+}
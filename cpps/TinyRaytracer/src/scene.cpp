@@ -0,0 +1,723 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "./scene.h"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <stdexcept>
+
+#include "./intersection.h"
+#include "./ray_counters.h"
+#include "geometry/utils.h"
+
+namespace {
+
+// Leaves are intersected in chunks: the distances of a chunk come out of a
+// loop without dependencies between iterations, which the compiler is free
+// to vectorize, and are compared only afterwards.
+const int kChunkSize = 8;
+
+template <class T>
+void Permute(std::vector<T> &values, const std::vector<int> &order) {
+  std::vector<T> permuted;
+  permuted.reserve(order.size());
+  for (int index : order) {
+    permuted.push_back(values[index]);
+  }
+  values.swap(permuted);
+}
+
+// Returns whether the hit was replaced.
+bool Update(float distance, PrimitiveType type, int index, int shape_id,
+            float &nearest_distance, HitRecord &hit) {
+  if (distance >= 0 &&
+      (distance < nearest_distance ||
+       (distance == nearest_distance && shape_id < hit.shape_id))) {
+    nearest_distance = distance;
+    hit.distance = distance;
+    hit.type = type;
+    hit.index = index;
+    hit.shape_id = shape_id;
+    return true;
+  }
+  return false;
+}
+
+void UpdateLanes(const PacketFloat &distances, const PacketMask &active,
+                 PrimitiveType type, int index, int shape_id,
+                 PacketFloat &nearest_distances,
+                 HitRecord (&hits)[kPacketSize]) {
+  PacketMask is_hit = (distances >= PacketFloat(0.f)) & active;
+  PacketMask is_nearer = is_hit & (distances < nearest_distances);
+  PacketMask is_tied = is_hit & (distances == nearest_distances);
+
+  int nearer_bits = is_nearer.GetBits();
+  for (int lane = 0; lane != kPacketSize; ++lane) {
+    if ((is_tied.GetBits() & (1 << lane)) &&
+        shape_id < hits[lane].shape_id) {
+      nearer_bits |= 1 << lane;
+    }
+  }
+
+  if (nearer_bits == 0) {
+    return;
+  }
+
+  nearest_distances =
+      Select(PacketMask::FromBits(nearer_bits), distances, nearest_distances);
+  for (int lane = 0; lane != kPacketSize; ++lane) {
+    if (nearer_bits & (1 << lane)) {
+      hits[lane].type = type;
+      hits[lane].index = index;
+      hits[lane].shape_id = shape_id;
+    }
+  }
+}
+
+Aabb TransformBounds(const Mat<4, 4, float> &transform, const Aabb &bounds) {
+  if (!bounds.IsFinite()) {
+    const float infinity = std::numeric_limits<float>::infinity();
+    return Aabb(Vec<3, float>({-infinity, -infinity, -infinity}),
+                Vec<3, float>({infinity, infinity, infinity}));
+  }
+
+  Aabb result;
+  for (int corner = 0; corner != 8; ++corner) {
+    result.Extend(TransformPoint(
+        transform, Vec<3, float>({corner & 1 ? bounds.max[0] : bounds.min[0],
+                                  corner & 2 ? bounds.max[1] : bounds.min[1],
+                                  corner & 4 ? bounds.max[2] : bounds.min[2]})));
+  }
+  return result;
+}
+
+}  // namespace
+
+int Scene::AddMaterial(const MaterialVariant &material) {
+  _materials.push_back(material);
+  return _materials.size() - 1;
+}
+
+void Scene::Add(const Sphere &sphere) {
+  _spheres.center_x.push_back(sphere._center[0]);
+  _spheres.center_y.push_back(sphere._center[1]);
+  _spheres.center_z.push_back(sphere._center[2]);
+  _spheres.radius.push_back(sphere._radius);
+  _spheres.radius_squared.push_back(sphere._radius * sphere._radius);
+  _spheres.material_ids.push_back(AddMaterial(sphere.GetMaterial()));
+  _spheres.shape_ids.push_back(_shape_count++);
+  _sphere_bounds.push_back(sphere.GetBounds());
+}
+
+void Scene::Add(const Plane &plane) {
+  _planes.center_x.push_back(plane._center[0]);
+  _planes.center_y.push_back(plane._center[1]);
+  _planes.center_z.push_back(plane._center[2]);
+  _planes.normal_x.push_back(plane._normal[0]);
+  _planes.normal_y.push_back(plane._normal[1]);
+  _planes.normal_z.push_back(plane._normal[2]);
+  _planes.half_width.push_back(plane._width / 2);
+  _planes.half_height.push_back(plane._height / 2);
+  _planes.material_ids.push_back(AddMaterial(plane.GetMaterial()));
+  _planes.shape_ids.push_back(_shape_count++);
+  _plane_bounds.push_back(plane.GetBounds());
+}
+
+void Scene::Add(std::shared_ptr<const TriangleMesh> mesh) {
+  _meshes.material_ids.push_back(AddMaterial(mesh->GetMaterial()));
+  _meshes.shape_ids.push_back(_shape_count++);
+  _mesh_bounds.push_back(mesh->GetBounds());
+  _meshes.meshes.push_back(std::move(mesh));
+}
+
+void Scene::Add(std::shared_ptr<const Scene> scene,
+                const Mat<4, 4, float> &transform) {
+  if (!scene->_instances.scenes.empty()) {
+    throw std::invalid_argument("Instanced scenes cannot contain instances.");
+  }
+
+  int material_offset = -1;
+  for (const auto &[instanced_scene, offset] : _instanced_material_offsets) {
+    if (instanced_scene == scene.get()) {
+      material_offset = offset;
+    }
+  }
+  if (material_offset == -1) {
+    material_offset = _materials.size();
+    _materials.insert(_materials.end(), scene->_materials.begin(),
+                      scene->_materials.end());
+    _instanced_material_offsets.emplace_back(scene.get(), material_offset);
+  }
+
+  _instances.inverse_transforms.push_back(GetAffineInverse(transform));
+  _instances.normal_transforms.push_back(GetNormalTransform(transform));
+  _instances.material_offsets.push_back(material_offset);
+  _instances.shape_ids.push_back(_shape_count++);
+  _instance_bounds.push_back(TransformBounds(transform, scene->GetBounds()));
+  _instances.scenes.push_back(std::move(scene));
+}
+
+void Scene::Build() {
+  _sphere_bvh = Bvh(_sphere_bounds);
+  const std::vector<int> &sphere_order = _sphere_bvh.GetPrimitiveIndices();
+  Permute(_spheres.center_x, sphere_order);
+  Permute(_spheres.center_y, sphere_order);
+  Permute(_spheres.center_z, sphere_order);
+  Permute(_spheres.radius, sphere_order);
+  Permute(_spheres.radius_squared, sphere_order);
+  Permute(_spheres.material_ids, sphere_order);
+  Permute(_spheres.shape_ids, sphere_order);
+  Permute(_sphere_bounds, sphere_order);
+
+  _plane_bvh = Bvh(_plane_bounds);
+  const std::vector<int> &plane_order = _plane_bvh.GetPrimitiveIndices();
+  Permute(_planes.center_x, plane_order);
+  Permute(_planes.center_y, plane_order);
+  Permute(_planes.center_z, plane_order);
+  Permute(_planes.normal_x, plane_order);
+  Permute(_planes.normal_y, plane_order);
+  Permute(_planes.normal_z, plane_order);
+  Permute(_planes.half_width, plane_order);
+  Permute(_planes.half_height, plane_order);
+  Permute(_planes.material_ids, plane_order);
+  Permute(_planes.shape_ids, plane_order);
+  Permute(_plane_bounds, plane_order);
+
+  _mesh_bvh = Bvh(_mesh_bounds);
+  const std::vector<int> &mesh_order = _mesh_bvh.GetPrimitiveIndices();
+  Permute(_meshes.meshes, mesh_order);
+  Permute(_meshes.material_ids, mesh_order);
+  Permute(_meshes.shape_ids, mesh_order);
+  Permute(_mesh_bounds, mesh_order);
+
+  _instance_bvh = Bvh(_instance_bounds);
+  const std::vector<int> &instance_order = _instance_bvh.GetPrimitiveIndices();
+  Permute(_instances.scenes, instance_order);
+  Permute(_instances.inverse_transforms, instance_order);
+  Permute(_instances.normal_transforms, instance_order);
+  Permute(_instances.material_offsets, instance_order);
+  Permute(_instances.shape_ids, instance_order);
+  Permute(_instance_bounds, instance_order);
+
+  _bounds = Aabb();
+  for (const std::vector<Aabb> *bounds :
+       {&_sphere_bounds, &_plane_bounds, &_mesh_bounds, &_instance_bounds}) {
+    for (const Aabb &primitive_bounds : *bounds) {
+      _bounds.Extend(primitive_bounds);
+    }
+  }
+}
+
+void Scene::IntersectMeshes(const Vec<3, float> &origin,
+                            const Vec<3, float> &direction,
+                            float &nearest_distance, HitRecord &hit) const {
+  _mesh_bvh.Traverse(
+      origin, direction, nearest_distance, [&](int first, int count) {
+        for (int i = first; i != first + count; ++i) {
+          MeshHit mesh_hit;
+          if (_meshes.meshes[i]->Intersect(origin, direction, nearest_distance,
+                                           mesh_hit) &&
+              Update(mesh_hit.distance, PrimitiveType::kMesh, i,
+                     _meshes.shape_ids[i], nearest_distance, hit)) {
+            hit.triangle = mesh_hit.triangle;
+            hit.u = mesh_hit.u;
+            hit.v = mesh_hit.v;
+          }
+        }
+        return false;
+      });
+}
+
+void Scene::GetObjectRay(int instance, const Vec<3, float> &origin,
+                         const Vec<3, float> &direction,
+                         Vec<3, float> &object_origin,
+                         Vec<3, float> &object_direction,
+                         float &scale) const {
+  const Mat<4, 4, float> &inverse = _instances.inverse_transforms[instance];
+  object_origin = TransformPoint(inverse, origin);
+  object_direction = TransformDirection(inverse, direction);
+  scale = object_direction.length();
+  object_direction /= scale;
+}
+
+void Scene::IntersectInstances(const Vec<3, float> &origin,
+                               const Vec<3, float> &direction,
+                               float &nearest_distance, HitRecord &hit) const {
+  _instance_bvh.Traverse(
+      origin, direction, nearest_distance, [&](int first, int count) {
+        CountRays(&RayCounters::instance_test_count, count);
+
+        for (int i = first; i != first + count; ++i) {
+          Vec<3, float> object_origin;
+          Vec<3, float> object_direction;
+          float scale;
+          GetObjectRay(i, origin, direction, object_origin, object_direction,
+                       scale);
+
+          HitRecord object_hit;
+          if (_instances.scenes[i]->Intersect(object_origin, object_direction,
+                                              nearest_distance * scale,
+                                              object_hit) &&
+              Update(object_hit.distance / scale, PrimitiveType::kInstance, i,
+                     _instances.shape_ids[i], nearest_distance, hit)) {
+            hit.object_type = object_hit.type;
+            hit.object_index = object_hit.index;
+            hit.triangle = object_hit.triangle;
+            hit.u = object_hit.u;
+            hit.v = object_hit.v;
+            hit.normal =
+                (_instances.normal_transforms[i] * object_hit.normal)
+                    .Normalize();
+            hit.material_id =
+                _instances.material_offsets[i] + object_hit.material_id;
+          }
+        }
+        return false;
+      });
+}
+
+bool Scene::Intersect(const Vec<3, float> &origin,
+                      const Vec<3, float> &direction, float max_distance,
+                      HitRecord &hit) const {
+  hit.distance = max_distance;
+  hit.index = -1;
+  hit.shape_id = -1;
+  float nearest_distance = max_distance;
+
+  _sphere_bvh.Traverse(
+      origin, direction, nearest_distance, [&](int first, int count) {
+        CountRays(&RayCounters::sphere_test_count, count);
+
+        for (int chunk = first; chunk < first + count; chunk += kChunkSize) {
+          const int chunk_end = std::min(chunk + kChunkSize, first + count);
+
+          float distances[kChunkSize];
+          for (int i = chunk; i != chunk_end; ++i) {
+            distances[i - chunk] = IntersectSphere(
+                origin, direction, nearest_distance, _spheres.center_x[i],
+                _spheres.center_y[i], _spheres.center_z[i],
+                _spheres.radius[i], _spheres.radius_squared[i]);
+          }
+
+          for (int i = chunk; i != chunk_end; ++i) {
+            Update(distances[i - chunk], PrimitiveType::kSphere, i,
+                   _spheres.shape_ids[i], nearest_distance, hit);
+          }
+        }
+        return false;
+      });
+
+  _plane_bvh.Traverse(
+      origin, direction, nearest_distance, [&](int first, int count) {
+        CountRays(&RayCounters::plane_test_count, count);
+
+        for (int chunk = first; chunk < first + count; chunk += kChunkSize) {
+          const int chunk_end = std::min(chunk + kChunkSize, first + count);
+
+          float distances[kChunkSize];
+          for (int i = chunk; i != chunk_end; ++i) {
+            distances[i - chunk] = IntersectPlane(
+                origin, direction, nearest_distance, _planes.center_x[i],
+                _planes.center_y[i], _planes.center_z[i], _planes.normal_x[i],
+                _planes.normal_y[i], _planes.normal_z[i],
+                _planes.half_width[i], _planes.half_height[i]);
+          }
+
+          for (int i = chunk; i != chunk_end; ++i) {
+            Update(distances[i - chunk], PrimitiveType::kPlane, i,
+                   _planes.shape_ids[i], nearest_distance, hit);
+          }
+        }
+        return false;
+      });
+
+  IntersectMeshes(origin, direction, nearest_distance, hit);
+  IntersectInstances(origin, direction, nearest_distance, hit);
+
+  if (hit.index == -1) {
+    return false;
+  }
+
+  FillSurface(origin, direction, hit);
+  return true;
+}
+
+void Scene::IntersectPacket(const RayPacket &packet,
+                            const PacketFloat &max_distance,
+                            HitRecord (&hits)[kPacketSize]) const {
+  for (HitRecord &hit : hits) {
+    hit.index = -1;
+    hit.shape_id = -1;
+  }
+  PacketFloat nearest_distances = max_distance;
+  const int active_lane_count =
+      std::popcount(static_cast<unsigned int>(packet.active.GetBits()));
+
+  _sphere_bvh.TraversePacket(
+      packet, nearest_distances, [&](int first, int count) {
+        CountRays(&RayCounters::sphere_test_count, count * active_lane_count);
+
+        for (int i = first; i != first + count; ++i) {
+          PacketFloat distances = IntersectSpherePacket(
+              packet, nearest_distances, _spheres.center_x[i],
+              _spheres.center_y[i], _spheres.center_z[i], _spheres.radius[i],
+              _spheres.radius_squared[i]);
+          UpdateLanes(distances, packet.active, PrimitiveType::kSphere, i,
+                      _spheres.shape_ids[i], nearest_distances, hits);
+        }
+        return false;
+      });
+
+  _plane_bvh.TraversePacket(
+      packet, nearest_distances, [&](int first, int count) {
+        CountRays(&RayCounters::plane_test_count, count * active_lane_count);
+
+        for (int i = first; i != first + count; ++i) {
+          PacketFloat distances = IntersectPlanePacket(
+              packet, nearest_distances, _planes.center_x[i],
+              _planes.center_y[i], _planes.center_z[i], _planes.normal_x[i],
+              _planes.normal_y[i], _planes.normal_z[i], _planes.half_width[i],
+              _planes.half_height[i]);
+          UpdateLanes(distances, packet.active, PrimitiveType::kPlane, i,
+                      _planes.shape_ids[i], nearest_distances, hits);
+        }
+        return false;
+      });
+
+  float distances[kPacketSize];
+  float origins[3][kPacketSize];
+  float directions[3][kPacketSize];
+  nearest_distances.Store(distances);
+  for (int axis = 0; axis != 3; ++axis) {
+    packet.origin[axis].Store(origins[axis]);
+    packet.direction[axis].Store(directions[axis]);
+  }
+
+  const int active_bits = packet.active.GetBits();
+  for (int lane = 0; lane != kPacketSize; ++lane) {
+    const Vec<3, float> origin(
+        {origins[0][lane], origins[1][lane], origins[2][lane]});
+    const Vec<3, float> direction(
+        {directions[0][lane], directions[1][lane], directions[2][lane]});
+
+    // Meshes bring their own SIMD, across the triangles of a leaf, and each
+    // instance needs the ray in its own space, so the lanes go through them
+    // one by one.
+    if (active_bits & (1 << lane)) {
+      if (!_meshes.meshes.empty()) {
+        IntersectMeshes(origin, direction, distances[lane], hits[lane]);
+      }
+      if (!_instances.scenes.empty()) {
+        IntersectInstances(origin, direction, distances[lane], hits[lane]);
+      }
+    }
+
+    hits[lane].distance = distances[lane];
+    if (hits[lane].index != -1) {
+      FillSurface(origin, direction, hits[lane]);
+    }
+  }
+}
+
+bool Scene::IntersectsPrimitive(PrimitiveType type, int index,
+                                const Vec<3, float> &origin,
+                                const Vec<3, float> &direction,
+                                float max_distance,
+                                const HitRecord &ignored) const {
+  const int i = index;
+
+  switch (type) {
+    case PrimitiveType::kSphere:
+      CountRays(&RayCounters::sphere_test_count);
+      return IntersectSphere(origin, direction, max_distance,
+                             _spheres.center_x[i], _spheres.center_y[i],
+                             _spheres.center_z[i], _spheres.radius[i],
+                             _spheres.radius_squared[i]) >= 0;
+    case PrimitiveType::kPlane:
+      CountRays(&RayCounters::plane_test_count);
+      return IntersectPlane(origin, direction, max_distance,
+                            _planes.center_x[i], _planes.center_y[i],
+                            _planes.center_z[i], _planes.normal_x[i],
+                            _planes.normal_y[i], _planes.normal_z[i],
+                            _planes.half_width[i], _planes.half_height[i]) >= 0;
+    case PrimitiveType::kMesh:
+      return _meshes.meshes[i]->IsOccluded(
+          origin, direction, max_distance,
+          ignored.type == PrimitiveType::kMesh && ignored.index == i
+              ? ignored.triangle
+              : -1);
+    case PrimitiveType::kInstance: {
+      CountRays(&RayCounters::instance_test_count);
+
+      Vec<3, float> object_origin;
+      Vec<3, float> object_direction;
+      float scale;
+      GetObjectRay(i, origin, direction, object_origin, object_direction,
+                   scale);
+
+      HitRecord object_ignored{};
+      object_ignored.index = -1;
+      if (ignored.type == PrimitiveType::kInstance && ignored.index == i) {
+        object_ignored.type = ignored.object_type;
+        object_ignored.index = ignored.object_index;
+        object_ignored.triangle = ignored.triangle;
+      }
+      return _instances.scenes[i]->IsOccluded(object_origin, object_direction,
+                                              max_distance * scale,
+                                              object_ignored);
+    }
+  }
+
+  throw std::runtime_error("Unknown primitive type.");
+}
+
+bool Scene::IsOccluded(const Vec<3, float> &origin,
+                       const Vec<3, float> &direction, float max_distance,
+                       const HitRecord &ignored, OccluderCache *cache) const {
+  // Meshes and instances are never skipped as a whole: the rest of them can
+  // still cast shadows onto the ignored part.
+  const auto is_ignored = [&](PrimitiveType type, int index) {
+    return type != PrimitiveType::kMesh && type != PrimitiveType::kInstance &&
+           ignored.index == index && ignored.type == type;
+  };
+
+  if (cache != nullptr) {
+    ++cache->query_count;
+
+    if (cache->index != -1 && !is_ignored(cache->type, cache->index) &&
+        IntersectsPrimitive(cache->type, cache->index, origin, direction,
+                            max_distance, ignored)) {
+      ++cache->hit_count;
+      return true;
+    }
+  }
+
+  bool is_occluded = false;
+
+  const auto test_leaf = [&](PrimitiveType type, int first, int count) {
+    for (int i = first; i != first + count; ++i) {
+      if (is_ignored(type, i) ||
+          !IntersectsPrimitive(type, i, origin, direction, max_distance,
+                               ignored)) {
+        continue;
+      }
+
+      if (cache != nullptr) {
+        cache->type = type;
+        cache->index = i;
+      }
+      is_occluded = true;
+      return true;
+    }
+    return false;
+  };
+
+  _sphere_bvh.Traverse(origin, direction, max_distance,
+                       [&](int first, int count) {
+                         return test_leaf(PrimitiveType::kSphere, first, count);
+                       });
+
+  if (is_occluded) {
+    return true;
+  }
+
+  _plane_bvh.Traverse(origin, direction, max_distance,
+                      [&](int first, int count) {
+                        return test_leaf(PrimitiveType::kPlane, first, count);
+                      });
+
+  if (is_occluded) {
+    return true;
+  }
+
+  _mesh_bvh.Traverse(origin, direction, max_distance,
+                     [&](int first, int count) {
+                       return test_leaf(PrimitiveType::kMesh, first, count);
+                     });
+
+  if (is_occluded) {
+    return true;
+  }
+
+  _instance_bvh.Traverse(
+      origin, direction, max_distance, [&](int first, int count) {
+        return test_leaf(PrimitiveType::kInstance, first, count);
+      });
+
+  return is_occluded;
+}
+
+PacketMask Scene::IntersectsPrimitivePacket(
+    PrimitiveType type, int index, const RayPacket &packet,
+    const PacketFloat &max_distance,
+    const HitRecord (&ignored)[kPacketSize]) const {
+  const int i = index;
+  const int active_bits = packet.active.GetBits();
+
+  // Meshes and instances test lane by lane, and are never ignored as a
+  // whole, like in IsOccluded().
+  if (type == PrimitiveType::kMesh || type == PrimitiveType::kInstance) {
+    float origins[3][kPacketSize];
+    float directions[3][kPacketSize];
+    float distances[kPacketSize];
+    for (int axis = 0; axis != 3; ++axis) {
+      packet.origin[axis].Store(origins[axis]);
+      packet.direction[axis].Store(directions[axis]);
+    }
+    max_distance.Store(distances);
+
+    int hit_bits = 0;
+    for (int lane = 0; lane != kPacketSize; ++lane) {
+      if ((active_bits & (1 << lane)) &&
+          IntersectsPrimitive(
+              type, i,
+              Vec<3, float>(
+                  {origins[0][lane], origins[1][lane], origins[2][lane]}),
+              Vec<3, float>({directions[0][lane], directions[1][lane],
+                             directions[2][lane]}),
+              distances[lane], ignored[lane])) {
+        hit_bits |= 1 << lane;
+      }
+    }
+    return PacketMask::FromBits(hit_bits);
+  }
+
+  int tested_bits = active_bits;
+  for (int lane = 0; lane != kPacketSize; ++lane) {
+    if (ignored[lane].index == i && ignored[lane].type == type) {
+      tested_bits &= ~(1 << lane);
+    }
+  }
+  if (tested_bits == 0) {
+    return PacketMask::FromBits(0);
+  }
+  CountRays(type == PrimitiveType::kSphere ? &RayCounters::sphere_test_count
+                                           : &RayCounters::plane_test_count,
+            std::popcount(static_cast<unsigned int>(tested_bits)));
+
+  PacketFloat distances =
+      type == PrimitiveType::kSphere
+          ? IntersectSpherePacket(packet, max_distance, _spheres.center_x[i],
+                                  _spheres.center_y[i], _spheres.center_z[i],
+                                  _spheres.radius[i],
+                                  _spheres.radius_squared[i])
+          : IntersectPlanePacket(packet, max_distance, _planes.center_x[i],
+                                 _planes.center_y[i], _planes.center_z[i],
+                                 _planes.normal_x[i], _planes.normal_y[i],
+                                 _planes.normal_z[i], _planes.half_width[i],
+                                 _planes.half_height[i]);
+  return (distances >= PacketFloat(0.f)) & PacketMask::FromBits(tested_bits);
+}
+
+PacketMask Scene::IsOccludedPacket(const RayPacket &packet,
+                                   const PacketFloat &max_distance,
+                                   const HitRecord (&ignored)[kPacketSize],
+                                   OccluderCache *cache) const {
+  // Lanes drop out of pending as soon as something blocks them.
+  RayPacket pending = packet;
+  PacketMask is_occluded = PacketMask::FromBits(0);
+
+  if (cache != nullptr) {
+    cache->query_count += std::popcount(
+        static_cast<unsigned int>(packet.active.GetBits()));
+
+    if (cache->index != -1) {
+      is_occluded = IntersectsPrimitivePacket(cache->type, cache->index,
+                                              pending, max_distance, ignored);
+      cache->hit_count +=
+          std::popcount(static_cast<unsigned int>(is_occluded.GetBits()));
+      pending.active = pending.active.AndNot(is_occluded);
+    }
+  }
+
+  const auto test_leaf = [&](PrimitiveType type, int first, int count) {
+    for (int i = first; i != first + count; ++i) {
+      PacketMask is_hit =
+          IntersectsPrimitivePacket(type, i, pending, max_distance, ignored);
+      if (!is_hit.Any()) {
+        continue;
+      }
+
+      if (cache != nullptr) {
+        cache->type = type;
+        cache->index = i;
+      }
+      is_occluded = is_occluded | is_hit;
+      pending.active = pending.active.AndNot(is_hit);
+      if (!pending.active.Any()) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  const std::pair<PrimitiveType, const Bvh *> bvhs[] = {
+      {PrimitiveType::kSphere, &_sphere_bvh},
+      {PrimitiveType::kPlane, &_plane_bvh},
+      {PrimitiveType::kMesh, &_mesh_bvh},
+      {PrimitiveType::kInstance, &_instance_bvh}};
+  for (const auto &[type, bvh] : bvhs) {
+    if (!pending.active.Any()) {
+      break;
+    }
+    bvh->TraversePacket(pending, max_distance, [&](int first, int count) {
+      return test_leaf(type, first, count);
+    });
+  }
+
+  return is_occluded;
+}
+
+void Scene::FillSurface(const Vec<3, float> &origin,
+                        const Vec<3, float> &direction, HitRecord &hit) const {
+  const int i = hit.index;
+  hit.point = origin + direction * hit.distance;
+
+  switch (hit.type) {
+    case PrimitiveType::kSphere:
+      hit.normal = (hit.point - Vec<3, float>({_spheres.center_x[i],
+                                               _spheres.center_y[i],
+                                               _spheres.center_z[i]}))
+                       .Normalize();
+      hit.material_id = _spheres.material_ids[i];
+      return;
+    case PrimitiveType::kPlane:
+      hit.normal = Vec<3, float>(
+          {_planes.normal_x[i], _planes.normal_y[i], _planes.normal_z[i]});
+      hit.material_id = _planes.material_ids[i];
+      return;
+    case PrimitiveType::kMesh:
+      hit.normal = _meshes.meshes[i]->GetNormal(
+          {hit.distance, hit.triangle, hit.u, hit.v});
+      hit.material_id = _meshes.material_ids[i];
+      return;
+    case PrimitiveType::kInstance:
+      // Filled in by IntersectInstances().
+      return;
+  }
+
+  throw std::runtime_error("Unknown primitive type.");
+}
@@ -24,83 +24,75 @@
 
 #include "./shape.h"
 
+#include <cmath>
+#include <limits>
+
+#include "./intersection.h"
+#include "checked_access.h"
 #include "geometry/utils.h"
 
 float Sphere::GetIntersectionDistance(const Vec<3, float> &origin,
                                       const Vec<3, float> &direction,
                                       float rayLength) const {
-  if (std::fabsf(direction.length() - 1.f) > kEpsilon) {
-    throw new std::out_of_range(
-        "The length of the direction vector must be 1.");
-  }
-
-  // 1. If the ray is already inside the sphere, return the value.
-  float distance_between_origins = (origin - _center).length();
-  if (distance_between_origins < _radius) {
-    return distance_between_origins;
-  }
-
-  // 2. If the ray direction is not pointing to the sphere, return -1.
-  Vec<3, float> origin_to_center = _center - origin;
-  if (origin_to_center * direction <= 0) {
-    return -1;
-  }
-
-  // 3. Get the nearest point from the ray to the sphere.
-  float distance_to_nearest = origin_to_center * direction;
-  Vec<3, float> nearest_point = origin + direction * distance_to_nearest;
-
-  // 4. If the distance between the nearest point and the sphere is more than
-  // the radius, return -1.
-  float distance_nearest_center = (nearest_point - _center).length();
-  if (distance_nearest_center > _radius) {
-    return -1;
+  if constexpr (kCheckedAccess) {
+    if (std::fabs(direction.length() - 1.f) > kEpsilon) {
+      throw new std::out_of_range(
+          "The length of the direction vector must be 1.");
+    }
   }
 
-  // 5. Get the distance between the ray origin and the intersecting point.
-  float distance_nearest_intersection = std::sqrt(
-      _radius * _radius - distance_nearest_center * distance_nearest_center);
-  float distance_origin_intersection =
-      distance_to_nearest - distance_nearest_intersection;
-
-  // 6. If the distance to intersection is over the ray length, return -1, else
-  // return the distance.
-  return distance_origin_intersection > rayLength
-             ? -1
-             : distance_origin_intersection;
+  return IntersectSphere(origin, direction, rayLength, _center[0], _center[1],
+                         _center[2], _radius, _radius * _radius);
 }
 
 float Plane::GetIntersectionDistance(const Vec<3, float> &origin,
                                      const Vec<3, float> &direction,
                                      float rayLength) const {
-  if (std::fabsf(direction.length() - 1.f) > kEpsilon) {
-    throw new std::out_of_range(
-        "The length of the direction vector must be 1.");
+  if constexpr (kCheckedAccess) {
+    if (std::fabs(direction.length() - 1.f) > kEpsilon) {
+      throw new std::out_of_range(
+          "The length of the direction vector must be 1.");
+    }
   }
 
-  // 1. If the ray is parallel to the plane, return -1.
-  float denominator = _normal * direction;
-  if (std::fabsf(denominator) < kEpsilon) {
-    return -1;
-  }
+  return IntersectPlane(origin, direction, rayLength, _center[0], _center[1],
+                        _center[2], _normal[0], _normal[1], _normal[2],
+                        _width / 2, _height / 2);
+}
 
-  // 2. Get the distance between the origin and the plane.
-  float distance = (_center - origin) * _normal / denominator;
+PacketFloat Sphere::GetPacketIntersectionDistances(
+    const RayPacket &packet, const PacketFloat &ray_length) const {
+  return IntersectSpherePacket(packet, ray_length, _center[0], _center[1],
+                               _center[2], _radius, _radius * _radius);
+}
 
-  // 3. If the distance is negative, return -1.
-  if (distance < 0) {
-    return -1;
-  }
+PacketFloat Plane::GetPacketIntersectionDistances(
+    const RayPacket &packet, const PacketFloat &ray_length) const {
+  return IntersectPlanePacket(packet, ray_length, _center[0], _center[1],
+                              _center[2], _normal[0], _normal[1], _normal[2],
+                              _width / 2, _height / 2);
+}
 
-  // 4. Get the intersection point.
-  Vec<3, float> intersection_point = origin + direction * distance;
+Aabb Sphere::GetBounds() const {
+  Vec<3, float> extent({_radius, _radius, _radius});
+  return Aabb(_center - extent, _center + extent);
+}
 
-  // 5. If the intersection point is inside the plane, return the distance.
-  if (std::fabsf(intersection_point[0] - _center[0]) <= _width / 2 &&
-      std::fabsf(intersection_point[2] - _center[2]) <= _height / 2) {
-    return distance;
+Aabb Plane::GetBounds() const {
+  // The plane is limited in x and z only, so its y range follows from the
+  // plane equation. A plane parallel to the y axis is unbounded.
+  float half_width = _width / 2;
+  float half_height = _height / 2;
+
+  float half_y = std::numeric_limits<float>::infinity();
+  if (std::fabs(_normal[1]) > kEpsilon) {
+    half_y = (std::fabs(_normal[0]) * half_width +
+              std::fabs(_normal[2]) * half_height) /
+             std::fabs(_normal[1]);
   }
 
-  // 6. Return -1.
-  return -1;
+  // Pad the box so that hits on the edges survive the slab test rounding.
+  Vec<3, float> extent(
+      {half_width + kEpsilon, half_y + kEpsilon, half_height + kEpsilon});
+  return Aabb(_center - extent, _center + extent);
 }
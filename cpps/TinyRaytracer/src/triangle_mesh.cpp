@@ -0,0 +1,181 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "./triangle_mesh.h"
+
+#include <cmath>
+#include <stdexcept>
+
+#include "./intersection.h"
+#include "./ray_counters.h"
+#include "./simd.h"
+#include "checked_access.h"
+
+TriangleMesh::TriangleMesh(const MaterialVariant &material, const Model &model,
+                           const Mat<4, 4, float> &transform)
+    : Shape(material) {
+  const Mat<3, 3, float> normal_transform = GetNormalTransform(transform);
+
+  std::vector<Vec<3, float>> positions[3];
+  std::vector<Vec<3, float>> normals[3];
+  std::vector<Aabb> triangle_bounds;
+
+  for (int face = 0; face != model.size(); ++face) {
+    const std::vector<Vertex> &vertices = model.get(face);
+
+    for (int i = 2; i < vertices.size(); ++i) {
+      const Vertex *corners[3] = {&vertices[0], &vertices[i - 1],
+                                  &vertices[i]};
+
+      Aabb bounds;
+      for (int corner = 0; corner != 3; ++corner) {
+        Vec<3, float> position =
+            TransformPoint(transform, corners[corner]->position);
+        positions[corner].push_back(position);
+        normals[corner].push_back(normal_transform * corners[corner]->normal);
+        bounds.Extend(position);
+      }
+      triangle_bounds.push_back(bounds);
+      _bounds.Extend(bounds);
+    }
+  }
+
+  _triangle_count = triangle_bounds.size();
+  _bvh = Bvh(triangle_bounds, kPacketSize);
+
+  for (int corner = 0; corner != 3; ++corner) {
+    for (int axis = 0; axis != 3; ++axis) {
+      _vertices[corner][axis].reserve(_triangle_count + kPacketSize);
+      _normals[corner][axis].reserve(_triangle_count);
+
+      for (int triangle : _bvh.GetPrimitiveIndices()) {
+        _vertices[corner][axis].push_back(positions[corner][triangle][axis]);
+        _normals[corner][axis].push_back(normals[corner][triangle][axis]);
+      }
+      _vertices[corner][axis].resize(_triangle_count + kPacketSize, 0.f);
+    }
+  }
+}
+
+bool TriangleMesh::Intersect(const Vec<3, float> &origin,
+                             const Vec<3, float> &direction,
+                             float max_distance, MeshHit &hit) const {
+  const WatertightRay ray = GetWatertightRay(origin, direction);
+  float nearest_distance = max_distance;
+  bool is_hit = false;
+
+  _bvh.Traverse(
+      origin, direction, nearest_distance, [&](int first, int count) {
+        CountRays(&RayCounters::triangle_test_count, count);
+
+        const float *vertices[3][3];
+        for (int corner = 0; corner != 3; ++corner) {
+          for (int axis = 0; axis != 3; ++axis) {
+            vertices[corner][axis] = &_vertices[corner][axis][first];
+          }
+        }
+
+        PacketFloat u;
+        PacketFloat v;
+        float distances[kPacketSize];
+        float us[kPacketSize];
+        float vs[kPacketSize];
+        IntersectTrianglesPacket(ray, vertices, PacketFloat(nearest_distance),
+                                 u, v)
+            .Store(distances);
+        u.Store(us);
+        v.Store(vs);
+
+        for (int lane = 0; lane != count; ++lane) {
+          if (distances[lane] >= 0 && distances[lane] < nearest_distance) {
+            nearest_distance = distances[lane];
+            hit = {distances[lane], first + lane, us[lane], vs[lane]};
+            is_hit = true;
+          }
+        }
+        return false;
+      });
+
+  return is_hit;
+}
+
+bool TriangleMesh::IsOccluded(const Vec<3, float> &origin,
+                              const Vec<3, float> &direction,
+                              float max_distance, int ignored_triangle) const {
+  const WatertightRay ray = GetWatertightRay(origin, direction);
+  bool is_occluded = false;
+
+  _bvh.Traverse(origin, direction, max_distance, [&](int first, int count) {
+    CountRays(&RayCounters::triangle_test_count, count);
+
+    const float *vertices[3][3];
+    for (int corner = 0; corner != 3; ++corner) {
+      for (int axis = 0; axis != 3; ++axis) {
+        vertices[corner][axis] = &_vertices[corner][axis][first];
+      }
+    }
+
+    PacketFloat u;
+    PacketFloat v;
+    int hit_bits = (IntersectTrianglesPacket(ray, vertices,
+                                             PacketFloat(max_distance), u, v) >=
+                    PacketFloat(0.f))
+                       .GetBits() &
+                   ((1 << count) - 1);
+    if (ignored_triangle >= first && ignored_triangle < first + count) {
+      hit_bits &= ~(1 << (ignored_triangle - first));
+    }
+
+    is_occluded = hit_bits != 0;
+    return is_occluded;
+  });
+
+  return is_occluded;
+}
+
+Vec<3, float> TriangleMesh::GetNormal(const MeshHit &hit) const {
+  const int i = hit.triangle;
+  const float w = 1 - hit.u - hit.v;
+
+  Vec<3, float> normal;
+  for (int axis = 0; axis != 3; ++axis) {
+    normal[axis] = _normals[0][axis][i] * w + _normals[1][axis][i] * hit.u +
+                   _normals[2][axis][i] * hit.v;
+  }
+  return normal.Normalize();
+}
+
+float TriangleMesh::GetIntersectionDistance(const Vec<3, float> &origin,
+                                            const Vec<3, float> &direction,
+                                            float rayLength) const {
+  if constexpr (kCheckedAccess) {
+    if (std::fabs(direction.length() - 1.f) > kEpsilon) {
+      throw new std::out_of_range(
+          "The length of the direction vector must be 1.");
+    }
+  }
+
+  MeshHit hit;
+  return Intersect(origin, direction, rayLength, hit) ? hit.distance : -1;
+}
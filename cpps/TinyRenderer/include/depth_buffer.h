@@ -0,0 +1,87 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "./image.h"
+
+// A 32 bit float depth target with a coarse hierarchical Z. Depths grow
+// towards the camera and start at 0. For every kBlockSize block and every
+// kTileSize tile, the least and the greatest depth in it are cached, so
+// that a triangle can be rejected as a whole where it is behind all of
+// them. Writes only mark the cache of their block and tile as stale; it is
+// brought up to date when it is read next.
+//
+// Nothing is locked. Pixels, blocks and tiles may be used from several
+// threads as long as every tile is used by one thread at a time, which is
+// what OurGL::DrawModel() does.
+class DepthBuffer {
+ public:
+  static constexpr int kBlockSize = 8;
+  static constexpr int kTileSize = 64;
+  static_assert(kTileSize % kBlockSize == 0);
+
+  DepthBuffer() : DepthBuffer(0, 0) {}
+  DepthBuffer(int width, int height);
+
+  int GetWidth() const { return depths_.GetWidth(); }
+  int GetHeight() const { return depths_.GetHeight(); }
+  const Image<float>& GetImage() const { return depths_; }
+
+  // Callers writing to a row call MarkBlockWritten() for every block they
+  // changed, before its depth range is read again.
+  float* GetRow(int y) { return depths_.GetRow(y); }
+  const float* GetRow(int y) const { return depths_.GetRow(y); }
+
+  void MarkBlockWritten(int block_x, int block_y);
+
+  // The depth range of a block or a tile, indexed in units of its size.
+  float GetBlockMinDepth(int block_x, int block_y);
+  float GetBlockMaxDepth(int block_x, int block_y);
+  float GetTileMinDepth(int tile_x, int tile_y);
+  float GetTileMaxDepth(int tile_x, int tile_y);
+
+  // Depths quantized to 8 bits as in z * 255, for PNG output.
+  Image<GrayscaleColor> ToGrayscaleImage() const;
+
+ private:
+  void UpdateBlock(int block_index);
+  void UpdateTile(int tile_index);
+
+  Image<float> depths_;
+
+  int block_columns_;
+  int block_rows_;
+  std::vector<float> block_min_depths_;
+  std::vector<float> block_max_depths_;
+  std::vector<uint8_t> is_block_stale_;
+
+  int tile_columns_;
+  std::vector<float> tile_min_depths_;
+  std::vector<float> tile_max_depths_;
+  std::vector<uint8_t> is_tile_stale_;
+};
@@ -0,0 +1,48 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "./geometry/vec.h"
+#include "./image.h"
+
+// What a deferred renderer keeps of the visible fragment of every pixel, to
+// light each pixel once after all faces are drawn. triangle_ids holds the
+// index of the face in the model, or -1 where no face was drawn; the other
+// images are only set where it is not -1.
+struct GBuffer {
+  GBuffer() = default;
+  GBuffer(int width, int height)
+      : triangle_ids(width, height),
+        positions(width, height),
+        normals(width, height),
+        texture_coords(width, height) {
+    triangle_ids.Fill(-1);
+  }
+
+  Image<int> triangle_ids;
+  Image<Vec<3, float>> positions;
+  Image<Vec<3, float>> normals;
+  Image<Vec<2, float>> texture_coords;
+};
@@ -26,12 +26,15 @@
 
 #include <algorithm>
 #include <cmath>
+#include <memory>
 #include <vector>
 
+#include "./depth_buffer.h"
 #include "./geometry/mat.h"
 #include "./geometry/vec.h"
 #include "./image.h"
 #include "./model.h"
+#include "./thread_pool.h"
 
 typedef Vec<3, float> gl_Position;
 typedef RgbaColor gl_Fragment;
@@ -40,6 +43,16 @@ class OurGL;
 
 class IShader {
  public:
+  virtual ~IShader() = default;
+
+  // A copy for another worker thread of DrawModel(), which shades vertices
+  // into the varyings of its own copy.
+  virtual std::unique_ptr<IShader> Clone() const = 0;
+
+  // Called with the index of every face in the model before its vertices
+  // are shaded, for shaders whose fragments need to know their face.
+  virtual void SetFaceIndex(int face_index) {}
+
   virtual gl_Position ShadeVertex(const OurGL& gl, Vertex model_vertex,
                                   int vertex_index) = 0;
   virtual gl_Fragment ShadeFragment(const OurGL& gl, Vec<3, float> gl_FragCoord,
@@ -53,23 +66,41 @@ class OurGL {
   int g_height;
 
   Mat<4, 4, float> u_vpm_mat;  // view * projection * model
-  Mat<4, 4, float> u_light_vpm_mat;
+  // kShadowDepthViewport * light view * projection * model, multiplied once
+  // per frame rather than for every fragment.
+  Mat<4, 4, float> u_shadow_depth_mat;
   Mat<4, 4, float> u_shadow_vpm_mat;
   Vec<3, float> u_light_dir;
   Vec<3, float> u_view_vector;
   Image<RgbaColor> u_texture;
   Image<RgbaColor> u_tangent_normal_map;
-  Image<GrayscaleColor>* u_shadow_depth_map;
-
-  OurGL() : g_width(0), g_height(0) {}
-
+  const DepthBuffer* u_shadow_depth_map;
+  // Number of worker threads of DrawModel(). 0 uses GetDefaultThreadCount().
+  int g_thread_count;
+
+  OurGL() : g_width(0), g_height(0), g_thread_count(0) {}
+
+  // Draws the faces in two parallel passes. The first shades the vertices
+  // and bins every face into the screen tiles its bounding box touches. The
+  // second draws every tile on one worker, with the faces binned there in
+  // model order. No pixel is shared by two workers, so the image is the same
+  // as drawing the faces one by one on a single thread. A fragment is drawn
+  // if its depth is at least the stored one, so a second pass over the same
+  // faces shades the visible fragments again.
   void DrawModel(const Model& model, IShader& shader, Image<RgbaColor>& image,
-                 Image<GrayscaleColor>& z_buffer);
+                 DepthBuffer& z_buffer);
 
  private:
+  // Draws the part of the triangle within the pixels [min_x, max_x) x
+  // [min_y, max_y) of a tile, skipping what the hierarchical Z of z_buffer
+  // shows to be hidden.
   void DrawTriangle(const std::array<gl_Position, 3>& gl_Positions,
                     IShader& shader, Image<RgbaColor>& image,
-                    Image<GrayscaleColor>& z_buffer);
+                    DepthBuffer& z_buffer, int tile_min_x, int tile_min_y,
+                    int tile_max_x, int tile_max_y);
+
+  // Created by the first DrawModel() and kept for the next ones.
+  std::unique_ptr<ThreadPool> thread_pool_;
 };
 
 Vec<3, float> GetBarycentric(const Vec<2, float>& target,
@@ -24,9 +24,11 @@
 
 #pragma once
 
+#include "./g_buffer.h"
 #include "./geometry/vec.h"
 #include "./image.h"
 #include "./model.h"
+#include "./our_gl.h"
 
 struct RenderModelResult {
   Image<RgbaColor> frame;
@@ -40,3 +42,26 @@ RenderModelResult RenderModel(const Model &model,
                               const Image<RgbaColor> &normal_map, int width,
                               int height, const Vec<3, float> &light_direction,
                               const Vec<3, float> &camera_position);
+
+// RenderModel() in two steps, with every visible pixel lit once. The
+// constructor draws the faces seen from camera_position into a G-buffer,
+// and Relight() lights it for a light at any position. Relighting draws
+// the shadow map again, but not the G-buffer. The images are the same as
+// those of RenderModel(). The model must outlive the renderer.
+class DeferredRenderer {
+ public:
+  DeferredRenderer(const Model &model, const Image<RgbaColor> &diffuse_texture,
+                   const Image<RgbaColor> &normal_map, int width, int height,
+                   const Vec<3, float> &camera_position);
+
+  RenderModelResult Relight(const Vec<3, float> &light_position);
+
+  const GBuffer &GetGBuffer() const { return g_buffer_; }
+
+ private:
+  const Model &model_;
+  OurGL gl_;
+  GBuffer g_buffer_;
+  Image<GrayscaleColor> z_image_;
+  Image<GrayscaleColor> ao_image_;
+};
@@ -24,24 +24,77 @@
 
 #pragma once
 
+#include <memory>
+
+#include "./g_buffer.h"
+#include "./geometry/utils.h"
 #include "./image.h"
 #include "./our_gl.h"
 
+// Maps the clip space of the light to the shadow map, x and y to texture
+// coordinates in [0, 1] and z to a depth in [0, 255]. Built at compile time.
+inline constexpr Mat<4, 4, float> kShadowDepthViewport =
+    Viewport(0.f, 0.f, 1.f, 1.f, 255.f);
+
+// What MainShader lights in a fragment, none of which depends on the light.
+struct Surface {
+  Vec<3, float> position;
+  // With the tangent normal map applied.
+  Vec<3, float> normal;
+  Vec<2, float> texture_coords;
+};
+
+// Phong shading and the shadow of a surface, with the light, the view and
+// the diffuse texture of gl.
+RgbaColor LightSurface(const OurGL& gl, const Surface& surface);
+
 class MainShader : public IShader {
  public:
+  std::unique_ptr<IShader> Clone() const override {
+    return std::make_unique<MainShader>(*this);
+  }
+
   gl_Position ShadeVertex(const OurGL& gl, Vertex model_vertex,
                           int vertex_index) override;
   gl_Fragment ShadeFragment(const OurGL& gl, Vec<3, float> gl_FragCoord,
                             const Vec<3, float> barycentric) const override;
 
+  // The surface at barycentric in the face whose vertices were shaded last.
+  Surface GetSurface(const OurGL& gl, const Vec<3, float> barycentric) const;
+
  private:
   Mat<3, 3, float> varying_positions;
   Mat<2, 3, float> varying_texcoords;
   Mat<3, 3, float> varying_normals;
 };
 
+// Writes the surfaces of MainShader to a G-buffer rather than lighting them,
+// at the pixel of every fragment.
+class GBufferShader : public MainShader {
+ public:
+  explicit GBufferShader(GBuffer* g_buffer)
+      : g_buffer(g_buffer), face_index(-1) {}
+
+  std::unique_ptr<IShader> Clone() const override {
+    return std::make_unique<GBufferShader>(*this);
+  }
+
+  void SetFaceIndex(int face_index) override { this->face_index = face_index; }
+
+  gl_Fragment ShadeFragment(const OurGL& gl, Vec<3, float> gl_FragCoord,
+                            const Vec<3, float> barycentric) const override;
+
+ private:
+  GBuffer* g_buffer;
+  int face_index;
+};
+
 class DepthShader : public IShader {
  public:
+  std::unique_ptr<IShader> Clone() const override {
+    return std::make_unique<DepthShader>(*this);
+  }
+
   gl_Position ShadeVertex(const OurGL& gl, Vertex model_vertex,
                           int vertex_index) override;
 
@@ -56,6 +109,10 @@ class DepthShader : public IShader {
 
 class ZShader : public IShader {
  public:
+  std::unique_ptr<IShader> Clone() const override {
+    return std::make_unique<ZShader>(*this);
+  }
+
   gl_Position ShadeVertex(const OurGL& gl, Vertex model_vertex,
                           int vertex_index) override;
 
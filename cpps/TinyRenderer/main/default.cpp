@@ -23,12 +23,18 @@
  */
 
 #include <filesystem>
+#include <string>
 
 #include "./file.h"
 #include "./geometry/vec.h"
 #include "./render.h"
 
-int main() {
+// Usage: TinyRenderer [--deferred]
+// With --deferred, the model is lit from a G-buffer rather than while its
+// faces are drawn. The images are the same.
+int main(int argc, char **argv) {
+  bool is_deferred = argc > 1 && std::string(argv[1]) == "--deferred";
+
   Model model("../assets/shark.obj");
 
   Image<RgbaColor> diffuse_texture = ReadPng("../assets/shark.png");
@@ -42,8 +48,12 @@ int main() {
   Vec<3, float> camera_position = {1.0f, 1.0f, 1.0f};
 
   RenderModelResult result =
-      RenderModel(model, diffuse_texture, normal_map, width, height,
-                  light_position, camera_position);
+      is_deferred
+          ? DeferredRenderer(model, diffuse_texture, normal_map, width,
+                             height, camera_position)
+                .Relight(light_position)
+          : RenderModel(model, diffuse_texture, normal_map, width, height,
+                        light_position, camera_position);
 
   std::filesystem::create_directory("../result");
 
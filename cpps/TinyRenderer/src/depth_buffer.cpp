@@ -0,0 +1,140 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "./depth_buffer.h"
+
+#include <algorithm>
+
+DepthBuffer::DepthBuffer(int width, int height)
+    : depths_(width, height),
+      block_columns_((width + kBlockSize - 1) / kBlockSize),
+      block_rows_((height + kBlockSize - 1) / kBlockSize),
+      tile_columns_((width + kTileSize - 1) / kTileSize) {
+  const int block_count = block_columns_ * block_rows_;
+  block_min_depths_.assign(block_count, 0.f);
+  block_max_depths_.assign(block_count, 0.f);
+  is_block_stale_.assign(block_count, 0);
+
+  const int tile_count = tile_columns_ * ((height + kTileSize - 1) / kTileSize);
+  tile_min_depths_.assign(tile_count, 0.f);
+  tile_max_depths_.assign(tile_count, 0.f);
+  is_tile_stale_.assign(tile_count, 0);
+}
+
+void DepthBuffer::MarkBlockWritten(int block_x, int block_y) {
+  constexpr int kBlocksPerTile = kTileSize / kBlockSize;
+
+  is_block_stale_[block_y * block_columns_ + block_x] = 1;
+  is_tile_stale_[block_y / kBlocksPerTile * tile_columns_ +
+                 block_x / kBlocksPerTile] = 1;
+}
+
+float DepthBuffer::GetBlockMinDepth(int block_x, int block_y) {
+  const int block_index = block_y * block_columns_ + block_x;
+  UpdateBlock(block_index);
+  return block_min_depths_[block_index];
+}
+
+float DepthBuffer::GetBlockMaxDepth(int block_x, int block_y) {
+  const int block_index = block_y * block_columns_ + block_x;
+  UpdateBlock(block_index);
+  return block_max_depths_[block_index];
+}
+
+float DepthBuffer::GetTileMinDepth(int tile_x, int tile_y) {
+  const int tile_index = tile_y * tile_columns_ + tile_x;
+  UpdateTile(tile_index);
+  return tile_min_depths_[tile_index];
+}
+
+float DepthBuffer::GetTileMaxDepth(int tile_x, int tile_y) {
+  const int tile_index = tile_y * tile_columns_ + tile_x;
+  UpdateTile(tile_index);
+  return tile_max_depths_[tile_index];
+}
+
+Image<GrayscaleColor> DepthBuffer::ToGrayscaleImage() const {
+  const int width = GetWidth();
+  const int height = GetHeight();
+
+  Image<GrayscaleColor> image(width, height);
+  for (int y = 0; y != height; ++y) {
+    const float* depth_row = depths_.GetRow(y);
+    GrayscaleColor* image_row = image.GetRow(y);
+    for (int x = 0; x != width; ++x) {
+      image_row[x] =
+          GrayscaleColor(static_cast<uint8_t>(depth_row[x] * 255.f));
+    }
+  }
+  return image;
+}
+
+void DepthBuffer::UpdateBlock(int block_index) {
+  if (!is_block_stale_[block_index]) {
+    return;
+  }
+  is_block_stale_[block_index] = 0;
+
+  const int min_x = block_index % block_columns_ * kBlockSize;
+  const int min_y = block_index / block_columns_ * kBlockSize;
+  const int max_x = std::min(min_x + kBlockSize, GetWidth());
+  const int max_y = std::min(min_y + kBlockSize, GetHeight());
+
+  float min_depth = depths_.GetRow(min_y)[min_x];
+  float max_depth = min_depth;
+  for (int y = min_y; y != max_y; ++y) {
+    const float* depth_row = depths_.GetRow(y);
+    for (int x = min_x; x != max_x; ++x) {
+      min_depth = std::min(min_depth, depth_row[x]);
+      max_depth = std::max(max_depth, depth_row[x]);
+    }
+  }
+  block_min_depths_[block_index] = min_depth;
+  block_max_depths_[block_index] = max_depth;
+}
+
+void DepthBuffer::UpdateTile(int tile_index) {
+  if (!is_tile_stale_[tile_index]) {
+    return;
+  }
+  is_tile_stale_[tile_index] = 0;
+
+  constexpr int kBlocksPerTile = kTileSize / kBlockSize;
+  const int min_block_x = tile_index % tile_columns_ * kBlocksPerTile;
+  const int min_block_y = tile_index / tile_columns_ * kBlocksPerTile;
+  const int max_block_x =
+      std::min(min_block_x + kBlocksPerTile, block_columns_);
+  const int max_block_y = std::min(min_block_y + kBlocksPerTile, block_rows_);
+
+  float min_depth = GetBlockMinDepth(min_block_x, min_block_y);
+  float max_depth = GetBlockMaxDepth(min_block_x, min_block_y);
+  for (int block_y = min_block_y; block_y != max_block_y; ++block_y) {
+    for (int block_x = min_block_x; block_x != max_block_x; ++block_x) {
+      min_depth = std::min(min_depth, GetBlockMinDepth(block_x, block_y));
+      max_depth = std::max(max_depth, GetBlockMaxDepth(block_x, block_y));
+    }
+  }
+  tile_min_depths_[tile_index] = min_depth;
+  tile_max_depths_[tile_index] = max_depth;
+}
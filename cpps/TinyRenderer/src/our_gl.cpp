@@ -27,23 +27,144 @@
 #include <math.h>
 
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <initializer_list>
+#include <memory>
+#include <utility>
+#include <vector>
 
 #include "./geometry/utils.h"
 
+namespace {
+
+// Fractional bits of the fixed point vertex coordinates of DrawTriangle().
+constexpr int kSubpixelBits = 8;
+constexpr float kSubpixelScale = 1 << kSubpixelBits;
+// Triangles with a vertex farther off screen than this, in pixels, are not
+// drawn. It keeps the fixed point edge functions within 64 bits; such
+// vertices only come from points next to the plane of the camera.
+constexpr float kGuardBand = 1 << 20;
+// Side of the square blocks that are accepted or rejected as a whole, by
+// coverage and by depth.
+constexpr int kBlockSize = DepthBuffer::kBlockSize;
+// Side of the square screen tiles that DrawModel() bins faces into. Tiles
+// are whole blocks, so blocks are aligned the same with and without tiles.
+constexpr int kTileSize = DepthBuffer::kTileSize;
+// Bound on the rounding error of a fragment depth relative to the depths of
+// the vertices, for comparisons against the hierarchical Z.
+constexpr float kDepthMargin = 1e-5f;
+
+std::array<gl_Position, 3> ShadeFace(const OurGL& gl, const Model& model,
+                                     int face_index, IShader& shader) {
+  const std::vector<Vertex>& face = model.get(face_index);
+  shader.SetFaceIndex(face_index);
+
+  std::array<gl_Position, 3> gl_Positions;
+  for (int v_idx = 0; v_idx != 3; ++v_idx) {
+    gl_Positions[v_idx] = shader.ShadeVertex(gl, face[v_idx], v_idx);
+  }
+  return gl_Positions;
+}
+
+// The pixels [min_x, max_x) x [min_y, max_y) that may be covered by a
+// triangle, with a margin of one pixel, clamped to the image.
+void GetPixelBounds(const std::array<gl_Position, 3>& gl_Positions, int width,
+                    int height, int& min_x, int& min_y, int& max_x,
+                    int& max_y) {
+  const Vec<3, float>& p0 = gl_Positions[0];
+  const Vec<3, float>& p1 = gl_Positions[1];
+  const Vec<3, float>& p2 = gl_Positions[2];
+
+  // Give some margin to avoid the edge of the triangle
+  min_x = std::min(p0[0], std::min(p1[0], p2[0])) - 1;
+  max_x = std::max(p0[0], std::max(p1[0], p2[0])) + 1;
+  min_y = std::min(p0[1], std::min(p1[1], p2[1])) - 1;
+  max_y = std::max(p0[1], std::max(p1[1], p2[1])) + 1;
+
+  // To handle the case where the coord is same with width or height
+  min_x = std::clamp(min_x, 0, width - 1);
+  min_y = std::clamp(min_y, 0, height - 1);
+  max_x = std::clamp(max_x, 0, width - 1);
+  max_y = std::clamp(max_y, 0, height - 1);
+}
+
+}  // namespace
+
 void OurGL::DrawModel(const Model& model, IShader& shader,
-                      Image<RgbaColor>& image,
-                      Image<GrayscaleColor>& z_buffer) {
-  for (int i = 0; i != model.size(); ++i) {
-    auto face = model.get(i);
-
-    std::array<gl_Position, 3> gl_Positions;
-    for (int v_idx = 0; v_idx != 3; ++v_idx) {
-      gl_Positions[v_idx] = shader.ShadeVertex(*this, face[v_idx], v_idx);
-    }
+                      Image<RgbaColor>& image, DepthBuffer& z_buffer) {
+  const int thread_count =
+      g_thread_count > 0 ? g_thread_count : GetDefaultThreadCount();
+  if (!thread_pool_ || thread_pool_->GetThreadCount() != thread_count) {
+    thread_pool_ = std::make_unique<ThreadPool>(thread_count);
+  }
 
-    DrawTriangle(gl_Positions, shader, image, z_buffer);
+  // Shaders keep the varyings of the face being drawn, so every worker but
+  // the calling one gets its own copy.
+  std::vector<std::unique_ptr<IShader>> worker_shaders(thread_count);
+  for (int i = 1; i != thread_count; ++i) {
+    worker_shaders[i] = shader.Clone();
   }
+  const auto get_shader = [&](int worker_index) -> IShader& {
+    return worker_index == 0 ? shader : *worker_shaders[worker_index];
+  };
+
+  const int width = z_buffer.GetWidth();
+  const int height = z_buffer.GetHeight();
+  const int tile_columns = (width + kTileSize - 1) / kTileSize;
+  const int tile_rows = (height + kTileSize - 1) / kTileSize;
+  const int tile_count = tile_columns * tile_rows;
+
+  // Binning. The faces are split into one contiguous chunk per worker, and
+  // every chunk has its own bins, so the bins need no locking and list
+  // their faces in model order.
+  const int face_count = model.size();
+  const int chunk_count = thread_count;
+  std::vector<std::vector<std::vector<int>>> bins(
+      chunk_count, std::vector<std::vector<int>>(tile_count));
+
+  thread_pool_->ParallelFor(chunk_count, [&](int chunk, int worker_index) {
+    IShader& worker_shader = get_shader(worker_index);
+    std::vector<std::vector<int>>& chunk_bins = bins[chunk];
+
+    const int begin = static_cast<long long>(face_count) * chunk / chunk_count;
+    const int end =
+        static_cast<long long>(face_count) * (chunk + 1) / chunk_count;
+    for (int i = begin; i != end; ++i) {
+      int min_x, min_y, max_x, max_y;
+      GetPixelBounds(ShadeFace(*this, model, i, worker_shader), width, height,
+                     min_x, min_y, max_x, max_y);
+      if (min_x >= max_x || min_y >= max_y) {
+        continue;
+      }
+
+      for (int row = min_y / kTileSize; row <= (max_y - 1) / kTileSize;
+           ++row) {
+        for (int column = min_x / kTileSize;
+             column <= (max_x - 1) / kTileSize; ++column) {
+          chunk_bins[row * tile_columns + column].push_back(i);
+        }
+      }
+    }
+  });
+
+  // Drawing. The varyings of the shader are not kept from binning, so the
+  // vertices of a face are shaded again in every tile it was binned into.
+  thread_pool_->ParallelFor(tile_count, [&](int tile, int worker_index) {
+    IShader& worker_shader = get_shader(worker_index);
+
+    const int min_x = (tile % tile_columns) * kTileSize;
+    const int min_y = (tile / tile_columns) * kTileSize;
+    const int max_x = std::min(min_x + kTileSize, width);
+    const int max_y = std::min(min_y + kTileSize, height);
+
+    for (const std::vector<std::vector<int>>& chunk_bins : bins) {
+      for (int i : chunk_bins[tile]) {
+        DrawTriangle(ShadeFace(*this, model, i, worker_shader), worker_shader,
+                     image, z_buffer, min_x, min_y, max_x, max_y);
+      }
+    }
+  });
 }
 
 Vec<3, float> GetBarycentric(const Vec<2, float>& target,
@@ -111,61 +232,218 @@ RgbaColor GetPhongColor(const Vec<3, float>& normal,
 
 void OurGL::DrawTriangle(const std::array<gl_Position, 3>& gl_Positions,
                          IShader& shader, Image<RgbaColor>& image,
-                         Image<GrayscaleColor>& z_buffer) {
+                         DepthBuffer& z_buffer, int tile_min_x, int tile_min_y,
+                         int tile_max_x, int tile_max_y) {
   const Vec<3, float>& p0 = gl_Positions[0];
   const Vec<3, float>& p1 = gl_Positions[1];
   const Vec<3, float>& p2 = gl_Positions[2];
 
-  // Give some margin to avoid the edge of the triangle
-  int min_x = std::min(p0[0], std::min(p1[0], p2[0])) - 1;
-  int max_x = std::max(p0[0], std::max(p1[0], p2[0])) + 1;
-  int min_y = std::min(p0[1], std::min(p1[1], p2[1])) - 1;
-  int max_y = std::max(p0[1], std::max(p1[1], p2[1])) + 1;
+  int min_x, min_y, max_x, max_y;
+  GetPixelBounds(gl_Positions, z_buffer.GetWidth(), z_buffer.GetHeight(),
+                 min_x, min_y, max_x, max_y);
+  min_x = std::max(min_x, tile_min_x);
+  min_y = std::max(min_y, tile_min_y);
+  max_x = std::min(max_x, tile_max_x);
+  max_y = std::min(max_y, tile_max_y);
+
+  // The depths of the fragments lie between those of the vertices, up to
+  // rounding. Nothing is drawn where even the nearest is behind the tile.
+  const float triangle_min_z = std::min(p0[2], std::min(p1[2], p2[2]));
+  const float triangle_max_z = std::max(p0[2], std::max(p1[2], p2[2]));
+  const float depth_margin =
+      kDepthMargin * std::max({1.f, -triangle_min_z, triangle_max_z});
+  if (triangle_max_z + depth_margin <
+      z_buffer.GetTileMinDepth(tile_min_x / kTileSize,
+                               tile_min_y / kTileSize)) {
+    return;
+  }
 
-  const int z_buffer_width = z_buffer.GetWidth();
-  const int z_buffer_height = z_buffer.GetHeight();
+  // Vertices in fixed point with kSubpixelBits fractional bits, so that the
+  // edge functions below are exact integers.
+  int64_t vertex_x[3];
+  int64_t vertex_y[3];
+  for (int i = 0; i != 3; ++i) {
+    const Vec<3, float>& p = gl_Positions[i];
+    if (!(std::fabs(p[0]) <= kGuardBand && std::fabs(p[1]) <= kGuardBand)) {
+      return;
+    }
+    vertex_x[i] = std::lround(p[0] * kSubpixelScale);
+    vertex_y[i] = std::lround(p[1] * kSubpixelScale);
+  }
 
-  // To handle the case where the coord is same with width or height
-  min_x = std::clamp(min_x, 0, z_buffer_width - 1);
-  min_y = std::clamp(min_y, 0, z_buffer_height - 1);
-  max_x = std::clamp(max_x, 0, z_buffer_width - 1);
-  max_y = std::clamp(max_y, 0, z_buffer_height - 1);
-
-  for (int x = min_x; x != max_x; ++x) {
-    for (int y = min_y; y != max_y; ++y) {
-      Vec<3, float> barycentric = GetBarycentric(
-          Vec<2, float>({static_cast<float>(x), static_cast<float>(y)}),
-          Vec<2, float>({static_cast<float>(p0[0]), static_cast<float>(p0[1])}),
-          Vec<2, float>({static_cast<float>(p1[0]), static_cast<float>(p1[1])}),
-          Vec<2, float>(
-              {static_cast<float>(p2[0]), static_cast<float>(p2[1])}));
-
-      if (barycentric[0] < 0 || barycentric[1] < 0 || barycentric[2] < 0) {
+  // Twice the signed area. Either winding is drawn: a clockwise triangle
+  // swaps its last two vertices here, and their weights back below.
+  int64_t area = (vertex_x[1] - vertex_x[0]) * (vertex_y[2] - vertex_y[0]) -
+                 (vertex_x[2] - vertex_x[0]) * (vertex_y[1] - vertex_y[0]);
+  if (area == 0) {
+    return;
+  }
+  const bool is_swapped = area < 0;
+  if (is_swapped) {
+    std::swap(vertex_x[1], vertex_x[2]);
+    std::swap(vertex_y[1], vertex_y[2]);
+    area = -area;
+  }
+  const double inverse_area = 1.0 / static_cast<double>(area);
+
+  // The edge function of vertex i is zero on the opposite edge, grows to
+  // area at the vertex, and is stepped by step_x and step_y per pixel. A
+  // pixel center on an edge belongs to the triangle only if the edge is a
+  // top or a left one, so that triangles sharing the edge draw it once. The
+  // other edges get a bias of -1, which makes zero fail the >= 0 test.
+  int64_t step_x[3];
+  int64_t step_y[3];
+  int64_t bias[3];
+  int64_t origin[3];  // At pixel (0, 0), bias included.
+  for (int i = 0; i != 3; ++i) {
+    const int j = (i + 1) % 3;
+    const int k = (i + 2) % 3;
+    const int64_t a = vertex_y[j] - vertex_y[k];
+    const int64_t b = vertex_x[k] - vertex_x[j];
+    const bool is_top_left = a > 0 || (a == 0 && b > 0);
+    bias[i] = is_top_left ? 0 : -1;
+    step_x[i] = a << kSubpixelBits;
+    step_y[i] = b << kSubpixelBits;
+    origin[i] = b * -vertex_y[j] + a * -vertex_x[j] + bias[i];
+  }
+
+  const auto get_weight = [&](int i, int x, int y) {
+    return origin[i] + step_x[i] * x + step_y[i] * y;
+  };
+
+  // The depth is linear in the edge functions as well, in double here.
+  double vertex_z[3] = {p0[2], p1[2], p2[2]};
+  if (is_swapped) {
+    std::swap(vertex_z[1], vertex_z[2]);
+  }
+  const auto get_z = [&](int x, int y) {
+    double z = 0;
+    for (int i = 0; i != 3; ++i) {
+      z += static_cast<double>(get_weight(i, x, y) - bias[i]) * vertex_z[i];
+    }
+    return z * inverse_area;
+  };
+  double z_step_x = 0;
+  double z_step_y = 0;
+  for (int i = 0; i != 3; ++i) {
+    z_step_x += static_cast<double>(step_x[i]) * vertex_z[i] * inverse_area;
+    z_step_y += static_cast<double>(step_y[i]) * vertex_z[i] * inverse_area;
+  }
+
+  // Whether the depth test passes or not, with is_in_front when it is known
+  // to pass for the whole block.
+  bool is_in_front = false;
+  bool is_written = false;
+
+  const auto shade_pixel = [&](int x, int y, float* z_row,
+                               RgbaColor* image_row, const int64_t* weights) {
+    float barycentric_weights[3];
+    for (int i = 0; i != 3; ++i) {
+      barycentric_weights[i] = static_cast<float>(
+          static_cast<double>(weights[i] - bias[i]) * inverse_area);
+    }
+    if (is_swapped) {
+      std::swap(barycentric_weights[1], barycentric_weights[2]);
+    }
+    const Vec<3, float> barycentric{barycentric_weights[0],
+                                    barycentric_weights[1],
+                                    barycentric_weights[2]};
+
+    if (auto z = barycentric[0] * p0[2] + barycentric[1] * p1[2] +
+                 barycentric[2] * p2[2];
+        is_in_front || (z_row[x] <= z && z <= 1)) {
+      // The pixel itself, as in GLSL, rather than the barycentric blend of
+      // the vertices that only comes close to it.
+      Vec<3, float> gl_FragCoord({
+          static_cast<float>(x),
+          static_cast<float>(y),
+          z,
+      });
+
+      RgbaColor fragment_color =
+          shader.ShadeFragment(*this, gl_FragCoord, barycentric);
+
+      z_row[x] = z;
+      image_row[x] = fragment_color;
+      is_written = true;
+    }
+  };
+
+  // The bounding box in kBlockSize blocks. An edge function is linear, so
+  // over a block it is largest and smallest at two opposite corners, picked
+  // by the signs of its steps. A block with the largest value outside one
+  // edge is skipped, and a block with the smallest values inside every edge
+  // is drawn without per pixel tests.
+  for (int block_y = min_y - min_y % kBlockSize; block_y < max_y;
+       block_y += kBlockSize) {
+    const int y0 = std::max(block_y, min_y);
+    const int y1 = std::min(block_y + kBlockSize, max_y);
+
+    for (int block_x = min_x - min_x % kBlockSize; block_x < max_x;
+         block_x += kBlockSize) {
+      const int x0 = std::max(block_x, min_x);
+      const int x1 = std::min(block_x + kBlockSize, max_x);
+
+      bool is_outside = false;
+      bool is_inside = true;
+      for (int i = 0; i != 3; ++i) {
+        const int64_t corner = get_weight(i, x0, y0);
+        const int64_t across_x = step_x[i] * (x1 - 1 - x0);
+        const int64_t across_y = step_y[i] * (y1 - 1 - y0);
+        const int64_t largest = corner + std::max<int64_t>(across_x, 0) +
+                                std::max<int64_t>(across_y, 0);
+        const int64_t smallest = corner + std::min<int64_t>(across_x, 0) +
+                                 std::min<int64_t>(across_y, 0);
+        is_outside |= largest < 0;
+        is_inside &= smallest >= 0;
+      }
+      if (is_outside) {
         continue;
       }
 
-      if (auto z = barycentric[0] * p0[2] + barycentric[1] * p1[2] +
-                   barycentric[2] * p2[2];
-          // TODO(Seongho Park): Make 255.f as a constant
-          static_cast<float>(z_buffer.at(x, y).value) / 255.f < z && z <= 1) {
-        float bar_x = std::max(barycentric[0] * p0[0] + barycentric[1] * p1[0] +
-                                   barycentric[2] * p2[0],
-                               0.f);
-        float bar_y = std::max(barycentric[0] * p0[1] + barycentric[1] * p1[1] +
-                                   barycentric[2] * p2[1],
-                               0.f);
-
-        Vec<3, float> gl_FragCoord({
-            bar_x,
-            bar_y,
-            z,
-        });
-
-        RgbaColor fragment_color =
-            shader.ShadeFragment(*this, gl_FragCoord, barycentric);
-
-        z_buffer.set(x, y, GrayscaleColor(static_cast<uint8_t>(z * 255.f)));
-        image.set(x, y, fragment_color);
+      // The depth range of the triangle over the block, from the corners
+      // as above, against the range stored for the block.
+      const double corner_z = get_z(x0, y0);
+      const double across_z_x = z_step_x * (x1 - 1 - x0);
+      const double across_z_y = z_step_y * (y1 - 1 - y0);
+      const double block_max_z = std::min<double>(
+          corner_z + std::max(across_z_x, 0.) + std::max(across_z_y, 0.),
+          triangle_max_z);
+      const double block_min_z = std::max<double>(
+          corner_z + std::min(across_z_x, 0.) + std::min(across_z_y, 0.),
+          triangle_min_z);
+
+      const int block_column = block_x / kBlockSize;
+      const int block_row = block_y / kBlockSize;
+      if (block_max_z + depth_margin <
+          z_buffer.GetBlockMinDepth(block_column, block_row)) {
+        continue;
+      }
+      is_in_front = block_min_z - depth_margin >
+                        z_buffer.GetBlockMaxDepth(block_column, block_row) &&
+                    block_max_z + depth_margin <= 1;
+      is_written = false;
+
+      for (int y = y0; y < y1; ++y) {
+        float* z_row = z_buffer.GetRow(y);
+        RgbaColor* image_row = image.GetRow(y);
+
+        int64_t weights[3];
+        for (int i = 0; i != 3; ++i) {
+          weights[i] = get_weight(i, x0, y);
+        }
+        for (int x = x0; x < x1; ++x) {
+          if (is_inside || (weights[0] | weights[1] | weights[2]) >= 0) {
+            shade_pixel(x, y, z_row, image_row, weights);
+          }
+          for (int i = 0; i != 3; ++i) {
+            weights[i] += step_x[i];
+          }
+        }
+      }
+
+      if (is_written) {
+        z_buffer.MarkBlockWritten(block_column, block_row);
       }
     }
   }
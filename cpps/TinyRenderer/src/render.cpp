@@ -30,21 +30,15 @@
 #include "./our_gl.h"
 #include "./shader.h"
 
-Image<GrayscaleColor> GenerateSsaoImage(const Model& model, OurGL& gl,
-                                        Image<GrayscaleColor>& z_buffer);
+namespace {
 
-RenderModelResult RenderModel(const Model& model,
-                              const Image<RgbaColor>& diffuse_texture,
-                              const Image<RgbaColor>& normal_map, int width,
-                              int height, const Vec<3, float>& light_position,
-                              const Vec<3, float>& camera_position) {
-  Image<RgbaColor> frame(width, height);
-  Image<GrayscaleColor> z_buffer(width, height);
-  Image<GrayscaleColor> shadow_map_buffer(width, height);
-
-  MainShader shader;
-  DepthShader depth_shader;
+Image<GrayscaleColor> GenerateSsaoImage(const Model& model, OurGL& gl,
+                                        DepthBuffer& z_buffer);
 
+// Sets the viewport, the camera and the textures of gl.
+void SetUpCamera(OurGL& gl, const Image<RgbaColor>& diffuse_texture,
+                 const Image<RgbaColor>& normal_map, int width, int height,
+                 const Vec<3, float>& camera_position) {
   Vec<3, float> center{0, 0, 0};
 
   Vec<3, float> up{0, 1, 0};
@@ -53,61 +47,148 @@ RenderModelResult RenderModel(const Model& model,
                                 ? up
                                 : Vec<3, float>({0, 0, 1});
 
-  Vec<3, float> light_up = !IsParallel((light_position - center), up)
-                               ? up
-                               : Vec<3, float>({0, 0, 1});
-
-  Vec<3, float> light_direction = (center - light_position).Normalize();
-
   Mat<4, 4, float> viewport_matrix = Viewport(0, 0, width, height, 1);
-  Mat<4, 4, float> perspective_matrix = Perspective(3);
+  constexpr Mat<4, 4, float> perspective_matrix = Perspective(3);
   const Mat<4, 4, float> view_matrix =
       ViewMatrix(camera_position, center, camera_up);
 
-  Mat<4, 4, float> light_view_matrix =
-      ViewMatrix(light_position, center, light_up);
-  Mat<4, 4, float> light_proj_matrix = Orthographic(4, 4, 4);
-  Mat<4, 4, float> light_vpm = light_proj_matrix * light_view_matrix;
-
-  OurGL gl;
-
   gl.g_viewport_mat = viewport_matrix;
   gl.g_width = width;
   gl.g_height = height;
 
   gl.u_vpm_mat = perspective_matrix * view_matrix;
-  gl.u_light_vpm_mat = light_vpm;
-  gl.u_light_dir = light_direction;
   gl.u_view_vector = camera_position - center;
   gl.u_texture = diffuse_texture;
   gl.u_tangent_normal_map = normal_map;
+}
+
+// Sets the light of gl and draws its shadow map, which gl then refers to.
+void SetUpLight(OurGL& gl, const Model& model,
+                const Vec<3, float>& light_position,
+                DepthBuffer& shadow_map_buffer) {
+  Vec<3, float> center{0, 0, 0};
+
+  Vec<3, float> up{0, 1, 0};
+
+  Vec<3, float> light_up = !IsParallel((light_position - center), up)
+                               ? up
+                               : Vec<3, float>({0, 0, 1});
+
+  Vec<3, float> light_direction = (center - light_position).Normalize();
+
+  Mat<4, 4, float> light_view_matrix =
+      ViewMatrix(light_position, center, light_up);
+  constexpr Mat<4, 4, float> light_proj_matrix = Orthographic(4, 4, 4);
+  Mat<4, 4, float> light_vpm = light_proj_matrix * light_view_matrix;
+
+  gl.u_shadow_depth_mat = kShadowDepthViewport * light_vpm;
+  gl.u_light_dir = light_direction;
   gl.u_shadow_depth_map = &shadow_map_buffer;
 
   gl.u_shadow_vpm_mat = light_vpm;
 
+  DepthShader depth_shader;
   Image<RgbaColor> null_image(gl.g_width, gl.g_height);
 
   gl.DrawModel(model, depth_shader, null_image, shadow_map_buffer);
+}
+
+}  // namespace
+
+RenderModelResult RenderModel(const Model& model,
+                              const Image<RgbaColor>& diffuse_texture,
+                              const Image<RgbaColor>& normal_map, int width,
+                              int height, const Vec<3, float>& light_position,
+                              const Vec<3, float>& camera_position) {
+  Image<RgbaColor> frame(width, height);
+  DepthBuffer z_buffer(width, height);
+  DepthBuffer shadow_map_buffer(width, height);
+
+  MainShader shader;
+
+  OurGL gl;
+  SetUpCamera(gl, diffuse_texture, normal_map, width, height,
+              camera_position);
+  SetUpLight(gl, model, light_position, shadow_map_buffer);
 
   Image<GrayscaleColor> ao_image = GenerateSsaoImage(model, gl, z_buffer);
   gl.DrawModel(model, shader, frame, z_buffer);
 
-  return {frame, z_buffer, shadow_map_buffer, ao_image};
+  return {frame, z_buffer.ToGrayscaleImage(),
+          shadow_map_buffer.ToGrayscaleImage(), ao_image};
 }
 
+DeferredRenderer::DeferredRenderer(const Model& model,
+                                   const Image<RgbaColor>& diffuse_texture,
+                                   const Image<RgbaColor>& normal_map,
+                                   int width, int height,
+                                   const Vec<3, float>& camera_position)
+    : model_(model), g_buffer_(width, height) {
+  SetUpCamera(gl_, diffuse_texture, normal_map, width, height,
+              camera_position);
+
+  // The depth pass of the ambient occlusion leaves the depths of the visible
+  // fragments, so only those pass the depth test of the G-buffer pass and
+  // get their surface computed.
+  DepthBuffer z_buffer(width, height);
+  ao_image_ = GenerateSsaoImage(model_, gl_, z_buffer);
+
+  GBufferShader shader(&g_buffer_);
+  Image<RgbaColor> null_image(width, height);
+  gl_.DrawModel(model_, shader, null_image, z_buffer);
+
+  z_image_ = z_buffer.ToGrayscaleImage();
+}
+
+RenderModelResult DeferredRenderer::Relight(
+    const Vec<3, float>& light_position) {
+  const int width = g_buffer_.triangle_ids.GetWidth();
+  const int height = g_buffer_.triangle_ids.GetHeight();
+
+  DepthBuffer shadow_map_buffer(width, height);
+  SetUpLight(gl_, model_, light_position, shadow_map_buffer);
+
+  Image<RgbaColor> frame(width, height);
+  for (int y = 0; y < height; y++) {
+    const int* triangle_id_row = g_buffer_.triangle_ids.GetRow(y);
+    const Vec<3, float>* position_row = g_buffer_.positions.GetRow(y);
+    const Vec<3, float>* normal_row = g_buffer_.normals.GetRow(y);
+    const Vec<2, float>* texture_coord_row =
+        g_buffer_.texture_coords.GetRow(y);
+    RgbaColor* frame_row = frame.GetRow(y);
+
+    for (int x = 0; x < width; x++) {
+      if (triangle_id_row[x] < 0) continue;
+
+      frame_row[x] = LightSurface(
+          gl_, {position_row[x], normal_row[x], texture_coord_row[x]});
+    }
+  }
+  gl_.u_shadow_depth_map = nullptr;
+
+  return {frame, z_image_, shadow_map_buffer.ToGrayscaleImage(), ao_image_};
+}
+
+namespace {
+
 // SSAO with simple angle calculation
 Image<GrayscaleColor> GenerateSsaoImage(const Model& model, OurGL& gl,
-                                        Image<GrayscaleColor>& z_buffer) {
+                                        DepthBuffer& depth_buffer) {
   Image<GrayscaleColor> ssao_image(gl.g_width, gl.g_height);
 
   Image<RgbaColor> null_image(gl.g_width, gl.g_height);
   ZShader z_shader;
 
-  gl.DrawModel(model, z_shader, null_image, z_buffer);
+  gl.DrawModel(model, z_shader, null_image, depth_buffer);
+  // The angles below are taken over depths in steps of 1 / 255.
+  const Image<GrayscaleColor> z_buffer = depth_buffer.ToGrayscaleImage();
 
-  for (int x = 0; x < gl.g_width; x++) {
-    for (int y = 0; y < gl.g_height; y++) {
-      int z_value = static_cast<int>(z_buffer.at(x, y).value);
+  for (int y = 0; y < gl.g_height; y++) {
+    const GrayscaleColor* z_row = z_buffer.GetRow(y);
+    GrayscaleColor* ssao_row = ssao_image.GetRow(y);
+
+    for (int x = 0; x < gl.g_width; x++) {
+      int z_value = static_cast<int>(z_row[x].value);
 
       if (z_value <= 0) continue;
 
@@ -122,7 +203,7 @@ Image<GrayscaleColor> GenerateSsaoImage(const Model& model, OurGL& gl,
 
           float distance = sqrt(dx * dx + dy * dy);
           int delta_z =
-              static_cast<int>(z_buffer.at(x + dx, y + dy).value) - z_value;
+              static_cast<int>(z_buffer.GetRow(y + dy)[x + dx].value) - z_value;
 
           float exposed_angle = std::max(
               0.f, atan2f(static_cast<float>(delta_z) / 255.f, distance));
@@ -136,9 +217,11 @@ Image<GrayscaleColor> GenerateSsaoImage(const Model& model, OurGL& gl,
       total = smoothstep(0.05, 0.95, total);
 
       int color_value = static_cast<int>(total * 255);
-      ssao_image.set(x, y, GrayscaleColor{static_cast<uint8_t>(color_value)});
+      ssao_row[x] = GrayscaleColor{static_cast<uint8_t>(color_value)};
     }
   }
 
   return ssao_image;
 }
+
+}  // namespace
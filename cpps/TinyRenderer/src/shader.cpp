@@ -45,6 +45,11 @@ gl_Position MainShader::ShadeVertex(const OurGL& gl, Vertex model_vertex,
 gl_Fragment MainShader::ShadeFragment(const OurGL& gl,
                                       Vec<3, float> gl_FragCoord,
                                       const Vec<3, float> barycentric) const {
+  return LightSurface(gl, GetSurface(gl, barycentric));
+}
+
+Surface MainShader::GetSurface(const OurGL& gl,
+                               const Vec<3, float> barycentric) const {
   Vec<3, float> position = varying_positions * barycentric;
   Vec<3, float> normal = varying_normals * barycentric;
   normal.Normalize();
@@ -80,34 +85,52 @@ gl_Fragment MainShader::ShadeFragment(const OurGL& gl,
                               normal * tangent_normal[2];
   real_normal.Normalize();
 
+  return {position, real_normal, texture_coords};
+}
+
+RgbaColor LightSurface(const OurGL& gl, const Surface& surface) {
+  const Vec<3, float>& position = surface.position;
+
   Vec<3, float> light_dir = gl.u_light_dir;
 
   RgbaColor texture_color =
-      FindNearestTextureColor(texture_coords, gl.u_texture);
+      FindNearestTextureColor(surface.texture_coords, gl.u_texture);
 
   RgbaColor phong_color =
-      GetPhongColor(real_normal, gl.u_view_vector, light_dir, texture_color);
+      GetPhongColor(surface.normal, gl.u_view_vector, light_dir, texture_color);
 
   // Get shadow
-  Mat<4, 4, float> shadow_depth_viewport = Viewport(0.f, 0.f, 1.f, 1.f, 255.f);
-
   Vec<4, float> screen_coord_from_light =
-      (shadow_depth_viewport * gl.u_light_vpm_mat *
-       Vec<4, float>({position[0], position[1], position[2], 1}));
+      gl.u_shadow_depth_mat *
+      Vec<4, float>({position[0], position[1], position[2], 1});
 
-  GrayscaleColor shadow_depth = FindNearestTextureColor(
+  float shadow_depth = FindNearestTextureColor(
       Vec<2, float>({screen_coord_from_light[0] / screen_coord_from_light[3],
                      screen_coord_from_light[1] / screen_coord_from_light[3]}),
-      *gl.u_shadow_depth_map);
+      gl.u_shadow_depth_map->GetImage());
 
-  if (screen_coord_from_light[2] + 0.05 * 255 <
-      static_cast<float>(shadow_depth.value)) {
+  if (screen_coord_from_light[2] + 0.05 * 255 < shadow_depth * 255.f) {
     return phong_color * 0.1;
   }
 
   return phong_color;
 }
 
+gl_Fragment GBufferShader::ShadeFragment(
+    const OurGL& gl, Vec<3, float> gl_FragCoord,
+    const Vec<3, float> barycentric) const {
+  const Surface surface = GetSurface(gl, barycentric);
+
+  const int x = static_cast<int>(gl_FragCoord[0]);
+  const int y = static_cast<int>(gl_FragCoord[1]);
+  g_buffer->triangle_ids.GetRow(y)[x] = face_index;
+  g_buffer->positions.GetRow(y)[x] = surface.position;
+  g_buffer->normals.GetRow(y)[x] = surface.normal;
+  g_buffer->texture_coords.GetRow(y)[x] = surface.texture_coords;
+
+  return RgbaColor(0, 0, 0, 0);
+}
+
 gl_Position DepthShader::ShadeVertex(const OurGL& gl, Vertex model_vertex,
                                      int vertex_index) {
   Vec<4, float> pos_4 =
@@ -0,0 +1,261 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+// Four floats in one SIMD register, for the Vec and Mat specializations of
+// the common sizes. kHasFloat4 tells whether the target has such registers;
+// without them Float4 is four plain floats and Vec and Mat keep their scalar
+// loops. Every operation works lane by lane in the same order as those loops,
+// so results are the same bit for bit with or without SIMD. Float4 is a
+// literal type, so that the constexpr Vec and Mat operations may name it.
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+inline constexpr bool kHasFloat4 = true;
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+inline constexpr bool kHasFloat4 = true;
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+inline constexpr bool kHasFloat4 = true;
+#else
+inline constexpr bool kHasFloat4 = false;
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+
+class Float4 {
+ public:
+  Float4() : value_(_mm_setzero_ps()) {}
+  explicit Float4(float value) : value_(_mm_set1_ps(value)) {}
+  Float4(float x, float y, float z, float w)
+      : value_(_mm_setr_ps(x, y, z, w)) {}
+  explicit constexpr Float4(__m128 value) : value_(value) {}
+
+  static Float4 Load(const float* values) {
+    return Float4(_mm_loadu_ps(values));
+  }
+  void Store(float* values) const { _mm_storeu_ps(values, value_); }
+
+  template <int lane>
+  float Get() const {
+    return _mm_cvtss_f32(
+        _mm_shuffle_ps(value_, value_, _MM_SHUFFLE(lane, lane, lane, lane)));
+  }
+
+  Float4 operator+(const Float4& o) const {
+    return Float4(_mm_add_ps(value_, o.value_));
+  }
+  Float4 operator-(const Float4& o) const {
+    return Float4(_mm_sub_ps(value_, o.value_));
+  }
+  Float4 operator*(const Float4& o) const {
+    return Float4(_mm_mul_ps(value_, o.value_));
+  }
+  Float4 operator/(const Float4& o) const {
+    return Float4(_mm_div_ps(value_, o.value_));
+  }
+
+  // Turns four rows into four columns.
+  friend void Transpose(Float4& r0, Float4& r1, Float4& r2, Float4& r3) {
+    _MM_TRANSPOSE4_PS(r0.value_, r1.value_, r2.value_, r3.value_);
+  }
+
+ private:
+  __m128 value_;
+};
+
+#elif defined(__ARM_NEON)
+
+class Float4 {
+ public:
+  Float4() : value_(vdupq_n_f32(0)) {}
+  explicit Float4(float value) : value_(vdupq_n_f32(value)) {}
+  Float4(float x, float y, float z, float w) {
+    const float values[4] = {x, y, z, w};
+    value_ = vld1q_f32(values);
+  }
+  explicit constexpr Float4(float32x4_t value) : value_(value) {}
+
+  static Float4 Load(const float* values) { return Float4(vld1q_f32(values)); }
+  void Store(float* values) const { vst1q_f32(values, value_); }
+
+  template <int lane>
+  float Get() const {
+    return vgetq_lane_f32(value_, lane);
+  }
+
+  Float4 operator+(const Float4& o) const {
+    return Float4(vaddq_f32(value_, o.value_));
+  }
+  Float4 operator-(const Float4& o) const {
+    return Float4(vsubq_f32(value_, o.value_));
+  }
+  Float4 operator*(const Float4& o) const {
+    return Float4(vmulq_f32(value_, o.value_));
+  }
+  Float4 operator/(const Float4& o) const {
+#if defined(__aarch64__)
+    return Float4(vdivq_f32(value_, o.value_));
+#else
+    // 32-bit NEON has no division, and its reciprocal estimate would round
+    // differently from the scalar code.
+    float a[4];
+    float b[4];
+    Store(a);
+    o.Store(b);
+    for (int i = 0; i != 4; ++i) a[i] /= b[i];
+    return Load(a);
+#endif
+  }
+
+  // Turns four rows into four columns.
+  friend void Transpose(Float4& r0, Float4& r1, Float4& r2, Float4& r3) {
+    float32x4x2_t t01 = vtrnq_f32(r0.value_, r1.value_);
+    float32x4x2_t t23 = vtrnq_f32(r2.value_, r3.value_);
+    r0.value_ =
+        vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    r1.value_ =
+        vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    r2.value_ =
+        vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    r3.value_ =
+        vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+  }
+
+ private:
+  float32x4_t value_;
+};
+
+#elif defined(__wasm_simd128__)
+
+class Float4 {
+ public:
+  Float4() : value_(wasm_f32x4_splat(0)) {}
+  explicit Float4(float value) : value_(wasm_f32x4_splat(value)) {}
+  Float4(float x, float y, float z, float w)
+      : value_(wasm_f32x4_make(x, y, z, w)) {}
+  explicit constexpr Float4(v128_t value) : value_(value) {}
+
+  static Float4 Load(const float* values) {
+    return Float4(wasm_v128_load(values));
+  }
+  void Store(float* values) const { wasm_v128_store(values, value_); }
+
+  template <int lane>
+  float Get() const {
+    return wasm_f32x4_extract_lane(value_, lane);
+  }
+
+  Float4 operator+(const Float4& o) const {
+    return Float4(wasm_f32x4_add(value_, o.value_));
+  }
+  Float4 operator-(const Float4& o) const {
+    return Float4(wasm_f32x4_sub(value_, o.value_));
+  }
+  Float4 operator*(const Float4& o) const {
+    return Float4(wasm_f32x4_mul(value_, o.value_));
+  }
+  Float4 operator/(const Float4& o) const {
+    return Float4(wasm_f32x4_div(value_, o.value_));
+  }
+
+  // Turns four rows into four columns.
+  friend void Transpose(Float4& r0, Float4& r1, Float4& r2, Float4& r3) {
+    v128_t t0 = wasm_i32x4_shuffle(r0.value_, r1.value_, 0, 4, 1, 5);
+    v128_t t1 = wasm_i32x4_shuffle(r2.value_, r3.value_, 0, 4, 1, 5);
+    v128_t t2 = wasm_i32x4_shuffle(r0.value_, r1.value_, 2, 6, 3, 7);
+    v128_t t3 = wasm_i32x4_shuffle(r2.value_, r3.value_, 2, 6, 3, 7);
+    r0.value_ = wasm_i32x4_shuffle(t0, t1, 0, 1, 4, 5);
+    r1.value_ = wasm_i32x4_shuffle(t0, t1, 2, 3, 6, 7);
+    r2.value_ = wasm_i32x4_shuffle(t2, t3, 0, 1, 4, 5);
+    r3.value_ = wasm_i32x4_shuffle(t2, t3, 2, 3, 6, 7);
+  }
+
+ private:
+  v128_t value_;
+};
+
+#else
+
+class Float4 {
+ public:
+  constexpr Float4() : values_{} {}
+  explicit constexpr Float4(float value)
+      : values_{value, value, value, value} {}
+  constexpr Float4(float x, float y, float z, float w) : values_{x, y, z, w} {}
+
+  static Float4 Load(const float* values) {
+    Float4 result;
+    for (int i = 0; i != 4; ++i) result.values_[i] = values[i];
+    return result;
+  }
+  void Store(float* values) const {
+    for (int i = 0; i != 4; ++i) values[i] = values_[i];
+  }
+
+  template <int lane>
+  float Get() const {
+    return values_[lane];
+  }
+
+  Float4 operator+(const Float4& o) const {
+    return Map(o, [](float a, float b) { return a + b; });
+  }
+  Float4 operator-(const Float4& o) const {
+    return Map(o, [](float a, float b) { return a - b; });
+  }
+  Float4 operator*(const Float4& o) const {
+    return Map(o, [](float a, float b) { return a * b; });
+  }
+  Float4 operator/(const Float4& o) const {
+    return Map(o, [](float a, float b) { return a / b; });
+  }
+
+  // Turns four rows into four columns.
+  friend void Transpose(Float4& r0, Float4& r1, Float4& r2, Float4& r3) {
+    Float4* rows[4] = {&r0, &r1, &r2, &r3};
+    for (int i = 0; i != 4; ++i) {
+      for (int j = i + 1; j != 4; ++j) {
+        float value = rows[i]->values_[j];
+        rows[i]->values_[j] = rows[j]->values_[i];
+        rows[j]->values_[i] = value;
+      }
+    }
+  }
+
+ private:
+  template <class Function>
+  Float4 Map(const Float4& o, Function function) const {
+    Float4 result;
+    for (int i = 0; i != 4; ++i) {
+      result.values_[i] = function(values_[i], o.values_[i]);
+    }
+    return result;
+  }
+
+  float values_[4];
+};
+
+#endif
@@ -25,16 +25,28 @@
 #pragma once
 
 #include <array>
+#include <initializer_list>
+#include <type_traits>
 
+#include "./checked_access.h"
+#include "./geometry/float4.h"
 #include "./geometry/vec.h"
 
 template <size_t n, size_t m, class t>
 class Mat {
   // row-first order
 
+  // The rows of Mat<4, 4, float> are SIMD registers where the target has
+  // them.
+  static constexpr bool kIsFloat4 =
+      kHasFloat4 && std::is_same_v<t, float> && n == 4 && m == 4;
+
  public:
-  Mat() : data(std::array<std::array<t, m>, n>{0}) {}
-  Mat(const std::initializer_list<std::initializer_list<t>> &list) {
+  constexpr Mat() : data{} {}
+  // The sizes of the lists are checked when the matrix is built, which is at
+  // compile time for a constexpr matrix.
+  constexpr Mat(const std::initializer_list<std::initializer_list<t>> &list)
+      : data{} {
     if (list.size() != n) {
       throw std::invalid_argument("Invalid initializer list size");
     }
@@ -54,28 +66,33 @@ class Mat {
     }
   }
 
-  std::array<t, m> &operator[](int i) {
-    if (i < 0 || i >= n) {
-      throw std::out_of_range("Index out of range");
+  constexpr std::array<t, m> &operator[](int i) noexcept(!kCheckedAccess) {
+    if constexpr (kCheckedAccess) {
+      if (i < 0 || i >= n) {
+        throw std::out_of_range("Index out of range");
+      }
     }
     return data[i];
   }
-  const std::array<t, m> &operator[](int i) const {
-    if (i < 0 || i >= n) {
-      throw std::out_of_range("Index out of range");
+  constexpr const std::array<t, m> &operator[](int i) const
+      noexcept(!kCheckedAccess) {
+    if constexpr (kCheckedAccess) {
+      if (i < 0 || i >= n) {
+        throw std::out_of_range("Index out of range");
+      }
     }
     return data[i];
   }
 
-  inline Mat<n, m, t> &operator+=(const Mat<n, m, t> &mat) {
+  inline constexpr Mat<n, m, t> &operator+=(const Mat<n, m, t> &mat) {
     for (int i = 0; i < n; i++) {
-      for (int j = 0; j < mat; j++) {
+      for (int j = 0; j < m; j++) {
         data[i][j] += mat.data[i][j];
       }
     }
     return *this;
   }
-  inline Mat<n, m, t> &operator-=(const Mat<n, m, t> &mat) {
+  inline constexpr Mat<n, m, t> &operator-=(const Mat<n, m, t> &mat) {
     for (int i = 0; i < n; i++) {
       for (int j = 0; j < m; j++) {
         data[i][j] -= mat.data[i][j];
@@ -84,19 +101,38 @@ class Mat {
     return *this;
   }
 
-  inline Mat<n, m, t> operator+(const Mat<n, m, t> &mat) const {
+  inline constexpr Mat<n, m, t> operator+(const Mat<n, m, t> &mat) const {
     Mat<n, m, t> result = *this;
     result += mat;
     return result;
   }
-  inline Mat<n, m, t> operator-(const Mat<n, m, t> &mat) const {
+  inline constexpr Mat<n, m, t> operator-(const Mat<n, m, t> &mat) const {
     Mat<n, m, t> result = *this;
     result -= mat;
     return result;
   }
 
   template <size_t l>
-  inline Mat<n, l, t> operator*(const Mat<m, l, t> &mat) const {
+  inline constexpr Mat<n, l, t> operator*(const Mat<m, l, t> &mat) const {
+    if constexpr (kIsFloat4 && l == 4) {
+      if (!std::is_constant_evaluated()) {
+        // Row i of the product sums the rows of mat scaled by row i of this
+        // matrix, from zero and in the order of the loop below.
+        const Float4 rows[4] = {
+            Float4::Load(mat[0].data()), Float4::Load(mat[1].data()),
+            Float4::Load(mat[2].data()), Float4::Load(mat[3].data())};
+        Mat<n, l, t> result;
+        for (int i = 0; i < n; i++) {
+          Float4 sum;
+          for (int k = 0; k < m; k++) {
+            sum = sum + Float4(data[i][k]) * rows[k];
+          }
+          sum.Store(result[i].data());
+        }
+        return result;
+      }
+    }
+
     Mat<n, l, t> result;
 
     for (int i = 0; i < n; i++) {
@@ -110,7 +146,25 @@ class Mat {
     return result;
   }
 
-  inline Vec<n, t> operator*(const Vec<m, t> &vec) const {
+  inline constexpr Vec<n, t> operator*(const Vec<m, t> &vec) const {
+    if constexpr (kIsFloat4) {
+      if (!std::is_constant_evaluated()) {
+        // The columns scaled by the elements of vec, summed from zero and in
+        // the order of the loop below.
+        Float4 columns[4] = {
+            Float4::Load(data[0].data()), Float4::Load(data[1].data()),
+            Float4::Load(data[2].data()), Float4::Load(data[3].data())};
+        Transpose(columns[0], columns[1], columns[2], columns[3]);
+        Float4 sum;
+        for (int j = 0; j < m; j++) {
+          sum = sum + columns[j] * Float4(vec[j]);
+        }
+        Vec<n, t> result;
+        result.SetFloat4(sum);
+        return result;
+      }
+    }
+
     Vec<n, t> result;
 
     for (int i = 0; i < n; i++) {
@@ -122,9 +176,11 @@ class Mat {
     return result;
   }
 
-  inline std::array<t, n> GetColumn(int j) const {
-    if (j < 0 || j >= m) {
-      throw std::out_of_range("Index out of range");
+  inline constexpr std::array<t, n> GetColumn(int j) const {
+    if constexpr (kCheckedAccess) {
+      if (j < 0 || j >= m) {
+        throw std::out_of_range("Index out of range");
+      }
     }
 
     std::array<t, n> column;
@@ -134,9 +190,11 @@ class Mat {
     return column;
   }
 
-  inline Vec<n, t> GetColumnVector(int j) const {
-    if (j < 0 || j >= m) {
-      throw std::out_of_range("Index out of range");
+  inline constexpr Vec<n, t> GetColumnVector(int j) const {
+    if constexpr (kCheckedAccess) {
+      if (j < 0 || j >= m) {
+        throw std::out_of_range("Index out of range");
+      }
     }
 
     Vec<n, t> column;
@@ -146,27 +204,36 @@ class Mat {
     return column;
   }
 
-  inline void SetColumn(int j, const Vec<n, t> &vec) {
+  inline constexpr void SetColumn(int j, const Vec<n, t> &vec) {
     for (int i = 0; i < n; i++) {
       data[i][j] = vec[i];
     }
   }
 
-  inline const std::array<t, n> &GetRow(int i) const {
-    if (i < 0 || i >= n) {
-      throw std::out_of_range("Index out of range");
+  inline constexpr const std::array<t, n> &GetRow(int i) const {
+    if constexpr (kCheckedAccess) {
+      if (i < 0 || i >= n) {
+        throw std::out_of_range("Index out of range");
+      }
     }
 
     return data[i];
   }
 
-  inline const Vec<m, t> &GetRowVector(int i) const {
-    return Vec<m, t>(GetRow(i));
+  inline constexpr Vec<m, t> GetRowVector(int i) const {
+    const std::array<t, m> &row = GetRow(i);
+    Vec<m, t> result;
+    for (int j = 0; j < m; j++) {
+      result[j] = row[j];
+    }
+    return result;
   }
 
-  inline void SetRow(int i, const Vec<m, t> &vec) {
-    if (i < 0 || i >= n) {
-      throw std::out_of_range("Index out of range");
+  inline constexpr void SetRow(int i, const Vec<m, t> &vec) {
+    if constexpr (kCheckedAccess) {
+      if (i < 0 || i >= n) {
+        throw std::out_of_range("Index out of range");
+      }
     }
 
     for (int j = 0; j < m; j++) {
@@ -175,7 +242,7 @@ class Mat {
   }
 
  private:
-  std::array<std::array<t, m>, n> data;
+  alignas(kIsFloat4 ? 16 : alignof(t)) std::array<std::array<t, m>, n> data;
 };
 
 template <size_t n, size_t m, class t>
@@ -29,7 +29,7 @@
 
 const float kEpsilon = 1e-5;
 
-inline Vec<3, float> GetNDC(const Vec<4, float>& vec) {
+inline constexpr Vec<3, float> GetNDC(const Vec<4, float>& vec) {
   if (vec[3] == 0) {
     throw std::runtime_error("GetNDC: Division by zero");
   }
@@ -37,8 +37,8 @@ inline Vec<3, float> GetNDC(const Vec<4, float>& vec) {
   return Vec<3, float>({vec[0] / vec[3], vec[1] / vec[3], vec[2] / vec[3]});
 }
 
-inline Vec<3, float> Reflect(const Vec<3, float>& incident,
-                             const Vec<3, float>& normal) {
+inline constexpr Vec<3, float> Reflect(const Vec<3, float>& incident,
+                                       const Vec<3, float>& normal) {
   return (incident - normal * 2 * (incident * normal));
 }
 
@@ -47,7 +47,7 @@ inline bool IsParallel(const Vec<3, float>& a, const Vec<3, float>& b) {
 }
 
 template <size_t n, class t>
-inline Mat<n, n, t> GetIdentityMat() {
+inline constexpr Mat<n, n, t> GetIdentityMat() {
   Mat<n, n, t> identity;
   for (int i = 0; i < n; i++) {
     identity[i][i] = 1;
@@ -75,7 +75,7 @@ inline Mat<4, 4, float> ViewMatrix(const Vec<3, float>& eye,
   return matrix;
 }
 
-inline Mat<4, 4, float> Perspective(float distance) {
+inline constexpr Mat<4, 4, float> Perspective(float distance) {
   if (distance == 0) {
     throw std::runtime_error("Distance cannot be zero");
   }
@@ -86,8 +86,8 @@ inline Mat<4, 4, float> Perspective(float distance) {
   return perspective;
 }
 
-inline Mat<4, 4, float> Orthographic(float width, float height,
-                                     float distance) {
+inline constexpr Mat<4, 4, float> Orthographic(float width, float height,
+                                               float distance) {
   if (width == 0) {
     throw std::runtime_error("Width cannot be zero");
   }
@@ -110,8 +110,8 @@ inline Mat<4, 4, float> Orthographic(float width, float height,
   return projection_matrix;
 }
 
-inline Mat<4, 4, float> Viewport(float x, float y, float width, float height,
-                                 float depth) {
+inline constexpr Mat<4, 4, float> Viewport(float x, float y, float width,
+                                           float height, float depth) {
   Mat<4, 4, float> viewport;
   viewport[0][0] = width / 2;
   viewport[0][3] = x + width / 2;
@@ -123,7 +123,7 @@ inline Mat<4, 4, float> Viewport(float x, float y, float width, float height,
   return viewport;
 }
 
-inline Mat<3, 3, float> Inverse(const Mat<3, 3, float> mat) {
+inline constexpr Mat<3, 3, float> Inverse(const Mat<3, 3, float> mat) {
   float det =
       mat[0][0] * mat[1][1] * mat[2][2] + mat[0][1] * mat[1][2] * mat[2][0] +
       mat[0][2] * mat[1][0] * mat[2][1] - mat[0][2] * mat[1][1] * mat[2][0] -
@@ -147,6 +147,66 @@ inline Mat<3, 3, float> Inverse(const Mat<3, 3, float> mat) {
   return result;
 }
 
+// The following treat a Mat<4, 4, float> as an affine transform, whose last
+// row is (0, 0, 0, 1).
+
+inline Vec<3, float> TransformPoint(const Mat<4, 4, float>& transform,
+                                    const Vec<3, float>& point) {
+  Vec<3, float> result;
+  for (int i = 0; i < 3; i++) {
+    result[i] = transform[i][0] * point[0] + transform[i][1] * point[1] +
+                transform[i][2] * point[2] + transform[i][3];
+  }
+  return result;
+}
+
+inline Vec<3, float> TransformDirection(const Mat<4, 4, float>& transform,
+                                        const Vec<3, float>& direction) {
+  Vec<3, float> result;
+  for (int i = 0; i < 3; i++) {
+    result[i] = transform[i][0] * direction[0] +
+                transform[i][1] * direction[1] +
+                transform[i][2] * direction[2];
+  }
+  return result;
+}
+
+inline Mat<3, 3, float> GetLinearPart(const Mat<4, 4, float>& transform) {
+  Mat<3, 3, float> linear;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      linear[i][j] = transform[i][j];
+    }
+  }
+  return linear;
+}
+
+inline Mat<4, 4, float> GetAffineInverse(const Mat<4, 4, float>& transform) {
+  Mat<3, 3, float> linear_inverse = Inverse(GetLinearPart(transform));
+
+  Mat<4, 4, float> inverse = GetIdentityMat<4, float>();
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      inverse[i][j] = linear_inverse[i][j];
+      inverse[i][3] -= linear_inverse[i][j] * transform[j][3];
+    }
+  }
+  return inverse;
+}
+
+// Normals go through the inverse transpose of the linear part, so that they
+// stay perpendicular to the transformed surface.
+inline Mat<3, 3, float> GetNormalTransform(const Mat<4, 4, float>& transform) {
+  Mat<3, 3, float> inverse = Inverse(GetLinearPart(transform));
+  Mat<3, 3, float> inverse_transpose;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      inverse_transpose[i][j] = inverse[j][i];
+    }
+  }
+  return inverse_transpose;
+}
+
 inline float smoothstep(float edge0, float edge1, float x) {
   // Clamp x to the [0, 1] range
   x = std::clamp((x - edge0) / (edge1 - edge0), 0.0f, 1.0f);
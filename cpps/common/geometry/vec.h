@@ -27,77 +27,141 @@
 #include <algorithm>
 #include <array>
 #include <cmath>
-#include <initializer_list>
 #include <iostream>
+#include <stdexcept>
+#include <type_traits>
+
+#include "./checked_access.h"
+#include "./geometry/float4.h"
 
 const float kPi = 3.14159265358979323846f;
 
 template <size_t n, class t>
 class Vec {
+  // Vec<3, float> and Vec<4, float> live in one 16-byte aligned SIMD
+  // register where the target has them. Vec<3, float> is padded to four
+  // floats then, and the padding lane is kept at zero.
+  static constexpr bool kIsFloat4 =
+      kHasFloat4 && std::is_same_v<t, float> && (n == 3 || n == 4);
+  static constexpr size_t kStorageSize = kIsFloat4 ? 4 : n;
+
+  // Whether an operation goes through Float4. Constant evaluation always
+  // takes the scalar loops, which give the same results.
+  static constexpr bool IsFloat4() {
+    return kIsFloat4 && !std::is_constant_evaluated();
+  }
+
  public:
-  Vec() : data(std::array<t, n>{0}) {}
-  Vec(const std::initializer_list<t> &list) {
-    if (list.size() != n) {
-      throw std::invalid_argument("Invalid initializer list size");
+  constexpr Vec() : data{} {}
+  // Takes exactly n elements, so a wrong count does not compile.
+  template <class... Elements>
+    requires(sizeof...(Elements) == n &&
+             (std::is_convertible_v<Elements, t> && ...))
+  constexpr Vec(Elements... elements)
+      : data{static_cast<t>(elements)...} {
+    if constexpr (kIsFloat4) {
+      if (!std::is_constant_evaluated()) {
+        // One store of all lanes, so that the next load of the register is
+        // not held up by the stores of single elements.
+        const t values[n] = {static_cast<t>(elements)...};
+        SetFloat4(Float4(values[0], values[1], values[2],
+                         n == 4 ? values[n - 1] : 0));
+      }
     }
-
-    std::copy(list.begin(), list.end(), data.begin());
   }
 
-  t &operator[](int i) {
-    if (i < 0 || i >= n) {
-      throw std::out_of_range("Index out of range");
+  constexpr t &operator[](int i) noexcept(!kCheckedAccess) {
+    if constexpr (kCheckedAccess) {
+      if (i < 0 || i >= n) {
+        throw std::out_of_range("Index out of range");
+      }
     }
     return data[i];
   }
-  const t &operator[](int i) const {
-    if (i < 0 || i >= n) {
-      throw std::out_of_range("Index out of range");
+  constexpr const t &operator[](int i) const noexcept(!kCheckedAccess) {
+    if constexpr (kCheckedAccess) {
+      if (i < 0 || i >= n) {
+        throw std::out_of_range("Index out of range");
+      }
     }
     return data[i];
   }
 
-  inline Vec<n, t> &operator+=(const Vec<n, t> &v) {
+  inline constexpr Vec<n, t> &operator+=(const Vec<n, t> &v) {
+    if (IsFloat4()) {
+      SetFloat4(GetFloat4() + v.GetFloat4());
+      return *this;
+    }
+
     for (int i = 0; i < n; i++) {
       data[i] += v.data[i];
     }
     return *this;
   }
-  inline Vec<n, t> &operator-=(const Vec<n, t> &v) {
+  inline constexpr Vec<n, t> &operator-=(const Vec<n, t> &v) {
+    if (IsFloat4()) {
+      SetFloat4(GetFloat4() - v.GetFloat4());
+      return *this;
+    }
+
     for (int i = 0; i < n; i++) {
       data[i] -= v.data[i];
     }
     return *this;
   }
 
-  inline Vec<n, t> &operator*=(t f) {
+  inline constexpr Vec<n, t> &operator*=(t f) {
+    if (IsFloat4()) {
+      // Keeps the padding at zero, unless f is infinite or NaN.
+      SetFloat4(GetFloat4() * Float4(f));
+      return *this;
+    }
+
     for (int i = 0; i < n; i++) {
       data[i] *= f;
     }
     return *this;
   }
-  inline Vec<n, t> &operator/=(t f) {
+  inline constexpr Vec<n, t> &operator/=(t f) {
     if (f == 0) {
       throw std::runtime_error("Vec /=: Division by zero");
     }
 
+    if (IsFloat4()) {
+      SetFloat4(GetFloat4() / Float4(f));
+      return *this;
+    }
+
     for (int i = 0; i < n; i++) {
       data[i] /= f;
     }
     return *this;
   }
 
-  inline Vec<n, t> operator+(const Vec<n, t> &v) const {
+  inline constexpr Vec<n, t> operator+(const Vec<n, t> &v) const {
     Vec<n, t> result = *this;
     result += v;
     return result;
   }
-  inline Vec<n, t> operator-(const Vec<n, t> &v) const {
+  inline constexpr Vec<n, t> operator-(const Vec<n, t> &v) const {
     Vec<n, t> result = *this;
     result -= v;
     return result;
   }
-  inline t operator*(const Vec<n, t> &v) const {
+  inline constexpr t operator*(const Vec<n, t> &v) const {
+    if (IsFloat4()) {
+      // The lanes are summed one by one from zero, as in the loop below.
+      Float4 products = GetFloat4() * v.GetFloat4();
+      t result = 0;
+      result += products.Get<0>();
+      result += products.Get<1>();
+      result += products.Get<2>();
+      if constexpr (n == 4) {
+        result += products.Get<3>();
+      }
+      return result;
+    }
+
     t result = 0;
     for (int i = 0; i < n; i++) {
       result += data[i] * v.data[i];
@@ -105,33 +169,37 @@ class Vec {
     return result;
   }
 
-  inline Vec<n, t> operator*(float f) const {
+  inline constexpr Vec<n, t> operator*(float f) const {
     Vec<n, t> result = *this;
     result *= f;
     return result;
   }
-  inline Vec<n, t> operator/(float f) const {
+  inline constexpr Vec<n, t> operator/(float f) const {
     Vec<n, t> result = *this;
     result /= f;
     return result;
   }
 
   // Specialization for cross product when n == 3
-  Vec<3, t> &operator^=(const Vec<3, t> &v) {
-    *this = Vec<3, t>{data[1] * v[2] - data[2] * v[1],
-                      data[2] * v[0] - data[0] * v[2],
-                      data[0] * v[1] - data[1] * v[0]};
+  constexpr Vec<3, t> &operator^=(const Vec<3, t> &v) {
+    *this = *this ^ v;
     return *this;
   }
 
   // Specialization for cross product when n == 3
-  Vec<3, t> operator^(const Vec<3, t> &v) const {
+  // It stays scalar for Vec<3, float> too: its operands are mostly built
+  // from single elements, and the lane shuffles cost more than they save.
+  constexpr Vec<3, t> operator^(const Vec<3, t> &v) const {
     return Vec<3, t>{data[1] * v[2] - data[2] * v[1],
                      data[2] * v[0] - data[0] * v[2],
                      data[0] * v[1] - data[1] * v[0]};
   }
 
   float length() const {
+    if (IsFloat4()) {
+      return std::sqrt(*this * *this);
+    }
+
     float sum = 0;
     for (int i = 0; i < n; i++) {
       sum += data[i] * data[i];
@@ -145,22 +213,42 @@ class Vec {
       throw std::runtime_error("Normalize: length cannot be zero!");
     }
 
+    if (IsFloat4()) {
+      SetFloat4(GetFloat4() / Float4(len));
+      return *this;
+    }
+
     for (int i = 0; i < n; i++) {
       data[i] /= len;
     }
     return *this;
   }
 
-  const Vec<n, t> &GetNormalized() const {
+  Vec<n, t> GetNormalized() const {
     Vec<n, t> result = *this;
     return result.Normalize();
   }
 
+  // Only for Vec<3, float> and Vec<4, float>: the register the vector lives
+  // in, and back.
+  Float4 GetFloat4() const {
+    if constexpr (kIsFloat4) {
+      return Float4::Load(data.data());
+    } else {
+      return Float4();
+    }
+  }
+  void SetFloat4(const Float4 &value) {
+    if constexpr (kIsFloat4) {
+      value.Store(data.data());
+    }
+  }
+
   template <class>
   friend std::ostream &operator<<(std::ostream &s, const Vec<n, t> &m);
 
  private:
-  std::array<t, n> data;
+  alignas(kIsFloat4 ? 16 : alignof(t)) std::array<t, kStorageSize> data;
 };
 
 template <size_t n, class t>
@@ -25,8 +25,13 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
+#include "./checked_access.h"
+
 struct RgbaColor {
   uint8_t r;
   uint8_t g;
@@ -111,21 +116,43 @@ class Image {
     }
   }
 
-  Color at(int x, int y) const {
-    if (x < 0 || x >= width_) {
-      throw std::out_of_range("x: " + std::to_string(x) +
-                              " is out of Image x range");
-    }
+  Color at(int x, int y) const noexcept(!kCheckedAccess) {
+    if constexpr (kCheckedAccess) {
+      if (x < 0 || x >= width_) {
+        throw std::out_of_range("x: " + std::to_string(x) +
+                                " is out of Image x range");
+      }
 
-    if (y < 0 || y >= height_) {
-      throw std::out_of_range("y: " + std::to_string(y) +
-                              " is out of Image y range");
+      if (y < 0 || y >= height_) {
+        throw std::out_of_range("y: " + std::to_string(y) +
+                                " is out of Image y range");
+      }
     }
 
     return data_[y * width_ + x];
   }
 
+  // The width_ pixels of row y, for loops that walk a row without computing
+  // every index. Only y is checked, and only with kCheckedAccess.
+  Color* GetRow(int y) noexcept(!kCheckedAccess) {
+    CheckRow(y);
+    return data_.data() + y * width_;
+  }
+  const Color* GetRow(int y) const noexcept(!kCheckedAccess) {
+    CheckRow(y);
+    return data_.data() + y * width_;
+  }
+
  private:
+  void CheckRow(int y) const noexcept(!kCheckedAccess) {
+    if constexpr (kCheckedAccess) {
+      if (y < 0 || y >= height_) {
+        throw std::out_of_range("y: " + std::to_string(y) +
+                                " is out of Image y range");
+      }
+    }
+  }
+
   int width_;
   int height_;
   std::vector<Color> data_;
@@ -24,6 +24,7 @@
 
 #pragma once
 
+#include <ostream>
 #include <string>
 #include <vector>
 
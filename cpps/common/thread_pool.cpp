@@ -0,0 +1,180 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "./thread_pool.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+int GetDefaultThreadCount() {
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+  return 1;
+#else
+  return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+#endif
+}
+
+ThreadPool::ThreadPool(int thread_count)
+    : task_(nullptr),
+      generation_(0),
+      running_workers_(0),
+      is_stopping_(false) {
+  if (thread_count <= 0) {
+    throw std::invalid_argument("The thread count must be positive.");
+  }
+
+  for (int i = 0; i != thread_count; ++i) {
+    queues_.push_back(std::make_unique<WorkerQueue>());
+  }
+
+  for (int i = 1; i != thread_count; ++i) {
+    threads_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    is_stopping_ = true;
+  }
+  start_condition_.notify_all();
+
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ThreadPool::ParallelFor(int task_count,
+                             const std::function<void(int, int)>& task) {
+  if (task_count <= 0) {
+    return;
+  }
+
+  // Hand out contiguous runs of tasks so each worker starts on neighbouring
+  // work; stealing takes care of whatever imbalance is left.
+  const int worker_count = GetThreadCount();
+  for (int worker_index = 0; worker_index != worker_count; ++worker_index) {
+    int begin = task_count * worker_index / worker_count;
+    int end = task_count * (worker_index + 1) / worker_count;
+
+    WorkerQueue& queue = *queues_[worker_index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    for (int task_index = begin; task_index != end; ++task_index) {
+      queue.tasks.push_back(task_index);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    exception_ = nullptr;
+    running_workers_ = worker_count;
+    ++generation_;
+  }
+  start_condition_.notify_all();
+
+  RunTasks(0);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_condition_.wait(lock, [this] { return running_workers_ == 0; });
+  task_ = nullptr;
+
+  if (exception_) {
+    std::rethrow_exception(exception_);
+  }
+}
+
+void ThreadPool::WorkerLoop(int worker_index) {
+  int seen_generation = 0;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_condition_.wait(lock, [this, seen_generation] {
+        return is_stopping_ || generation_ != seen_generation;
+      });
+
+      if (is_stopping_) {
+        return;
+      }
+
+      seen_generation = generation_;
+    }
+
+    RunTasks(worker_index);
+  }
+}
+
+void ThreadPool::RunTasks(int worker_index) {
+  int task_index;
+
+  while (PopTask(worker_index, task_index) ||
+         StealTask(worker_index, task_index)) {
+    try {
+      (*task_)(task_index, worker_index);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!exception_) {
+        exception_ = std::current_exception();
+      }
+    }
+  }
+
+  // No task is ever added during a batch, so once every queue looked empty
+  // this worker is done.
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (--running_workers_ == 0) {
+    done_condition_.notify_all();
+  }
+}
+
+bool ThreadPool::PopTask(int worker_index, int& task_index) {
+  WorkerQueue& queue = *queues_[worker_index];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+
+  if (queue.tasks.empty()) {
+    return false;
+  }
+
+  task_index = queue.tasks.front();
+  queue.tasks.pop_front();
+  return true;
+}
+
+bool ThreadPool::StealTask(int worker_index, int& task_index) {
+  const int worker_count = GetThreadCount();
+
+  for (int offset = 1; offset < worker_count; ++offset) {
+    WorkerQueue& victim = *queues_[(worker_index + offset) % worker_count];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+
+    if (!victim.tasks.empty()) {
+      task_index = victim.tasks.back();
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+
+  return false;
+}
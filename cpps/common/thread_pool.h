@@ -0,0 +1,83 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Seongho Park
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Returns the number of worker threads to use when the caller does not
+// specify one. WebAssembly builds without pthreads always get 1.
+int GetDefaultThreadCount();
+
+// A fixed set of workers that run index-based task batches. Every worker owns
+// a deque of task indices; when it runs dry it steals from the back of another
+// worker's deque, so uneven task costs are balanced without a central queue.
+// The calling thread takes part as worker 0, so a pool of size 1 spawns no
+// threads at all.
+class ThreadPool {
+ public:
+  explicit ThreadPool(int thread_count);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int GetThreadCount() const { return static_cast<int>(queues_.size()); }
+
+  // Calls task(task_index, worker_index) for every task_index in
+  // [0, task_count) and blocks until all of them have finished. The first
+  // exception thrown by a task is rethrown here.
+  void ParallelFor(int task_count,
+                   const std::function<void(int, int)>& task);
+
+ private:
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<int> tasks;
+  };
+
+  void WorkerLoop(int worker_index);
+  void RunTasks(int worker_index);
+  bool PopTask(int worker_index, int& task_index);
+  bool StealTask(int worker_index, int& task_index);
+
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable start_condition_;
+  std::condition_variable done_condition_;
+  const std::function<void(int, int)>* task_;
+  std::exception_ptr exception_;
+  int generation_;
+  int running_workers_;
+  bool is_stopping_;
+};